@@ -1,3 +1,27 @@
+// (Re)defined on every include since they are undefined again at the end of each instantiation
+#ifndef OMP_PARALLEL_MIN_SIZE
+#define OMP_PARALLEL_MIN_SIZE_DEFINED
+#define OMP_PARALLEL_MIN_SIZE 1000
+#endif
+
+#ifndef CHAR_EQUAL
+#define CHAR_EQUAL_DEFINED
+#ifndef HIRSCHBERG_CASE_SENSITIVE
+#define CHAR_EQUAL(a, b) (tolower(a) == tolower(b))
+#else
+#define CHAR_EQUAL(a, b) ((a) == (b))
+#endif
+#endif
+
+#ifndef UTF8_CHAR_EQUAL
+#define UTF8_CHAR_EQUAL_DEFINED
+#ifndef HIRSCHBERG_CASE_SENSITIVE
+#define UTF8_CHAR_EQUAL(a, b) (utf8proc_tolower(a) == utf8proc_tolower(b))
+#else
+#define UTF8_CHAR_EQUAL(a, b) ((a) == (b))
+#endif
+#endif
+
 #ifndef HIRSCHBERG_H
 #define HIRSCHBERG_H
 
@@ -5,8 +29,14 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <math.h>
 #include <string.h>
+#include <ctype.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "utf8proc/utf8proc.h"
 
@@ -26,21 +56,21 @@ typedef struct {
 
 #define NULL_SUBPROBLEM ((string_subproblem_t){ .x = 0, .m = 0, .y = 0, .n = 0})
 
+static inline bool subproblem_equals(string_subproblem_t a, string_subproblem_t b) {
+    return a.x == b.x && a.m == b.m && a.y == b.y && a.n == b.n;
+}
+
 #define ARRAY_NAME string_subproblem_array
 #define ARRAY_TYPE string_subproblem_t
 #include "array/array.h"
 #undef ARRAY_NAME
 #undef ARRAY_TYPE
 
-#ifndef OMP_PARALLEL_MIN_SIZE
-#define OMP_PARALLEL_MIN_SIZE_DEFINED
-#define OMP_PARALLEL_MIN_SIZE 1000
-#endif
-
 typedef enum {
     VALUE_FUNCTION_STANDARD = 0,
     VALUE_FUNCTION_OPTIONS = 1,
-    VALUE_FUNCTION_VARARGS = 2
+    VALUE_FUNCTION_VARARGS = 2,
+    VALUE_FUNCTION_PREPARED = 3
 } hirschberg_value_function_type_t;
 
 typedef struct {
@@ -73,15 +103,6 @@ static inline size_t utf8_prev(const char *str, size_t start) {
 }
 
 
-#ifndef CHAR_EQUAL
-#define CHAR_EQUAL_DEFINED
-#ifndef HIRSCHBERG_CASE_SENSITIVE
-#define CHAR_EQUAL(a, b) (tolower(a) == tolower(b))
-#else
-#define CHAR_EQUAL(a, b) ((a) == (b))
-#endif
-#endif
-
 static inline bool subproblem_border_transpose(const char *s1, const char *s2, string_subproblem_t sub, size_t split) {
     if (sub.m == 0 || sub.n == 0 || split == 0) return false;
     char split_left = s1[split - 1];
@@ -95,15 +116,6 @@ static inline bool subproblem_border_transpose(const char *s1, const char *s2, s
     return false;
 }
 
-#ifndef UTF8_CHAR_EQUAL
-#define UTF8_CHAR_EQUAL_DEFINED
-#ifndef HIRSCHBERG_CASE_SENSITIVE
-#define UTF8_CHAR_EQUAL(a, b) (utf8proc_tolower(a) == utf8proc_tolower(b))
-#else
-#define UTF8_CHAR_EQUAL(a, b) ((a) == (b))
-#endif
-#endif
-
 static inline bool subproblem_border_transpose_utf8(const char *s1, const char *s2, string_subproblem_t sub, size_t split) {
     if (sub.m == 0 || sub.n == 0 || split == 0) return false;
     int32_t left_ch = 0;
@@ -141,135 +153,1069 @@ static inline bool subproblem_border_transpose_utf8(const char *s1, const char *
     return false;
 }
 
-#endif // HIRSCHBERG_H
+// Whether a subproblem is a leaf of the recursion (emitted as a result rather than split further).
+// Also reports whether either side is a single character, which constrains the split.
+static inline bool subproblem_is_result(string_pair_input_t input, bool utf8, string_subproblem_t sub, bool *single_char_m, bool *single_char_n) {
+    const char *s1 = input.s1 + sub.x;
+    const char *s2 = input.s2 + sub.y;
+    size_t m = sub.m;
+    size_t n = sub.n;
 
-#ifndef VALUE_TYPE
-#error "Must define VALUE_TYPE"
-#endif
+    *single_char_m = false;
+    *single_char_n = false;
 
-#ifndef VALUE_NAME
-#error "Must define VALUE_NAME"
-#endif
+    if (m == 0 || n == 0) return true;
 
-#if !defined(HIRSCHBERG_SIMILARITY) && !defined(MAX_VALUE)
-#error "Must define MAX_VALUE for distance functions"
-#endif
+    if (utf8) {
+        int32_t s1_c1 = 0, s1_c2 = 0, s2_c1 = 0, s2_c2 = 0;
+        utf8proc_ssize_t s1_c1_len = utf8proc_iterate((const uint8_t *)s1, -1, &s1_c1);
+        utf8proc_ssize_t s2_c1_len = utf8proc_iterate((const uint8_t *)s2, -1, &s2_c1);
+        if (s1_c1_len == m && s2_c1_len == n) {
+            return true;
+        } else if (s1_c1_len == m) {
+            *single_char_m = true;
+        } else if (s2_c1_len == n) {
+            *single_char_n = true;
+        }
+        utf8proc_ssize_t s1_c2_len = utf8proc_iterate((const uint8_t *)s1 + s1_c1_len, -1, &s1_c2);
+        utf8proc_ssize_t s2_c2_len = utf8proc_iterate((const uint8_t *)s2 + s2_c1_len, -1, &s2_c2);
+        if (s1_c1_len + s1_c2_len == m && s2_c1_len + s2_c2_len == n
+            && UTF8_CHAR_EQUAL(s1_c1, s2_c2)
+            && UTF8_CHAR_EQUAL(s1_c2, s2_c1)
+            && !(UTF8_CHAR_EQUAL(s1_c1, s1_c2))
+        ) {
+            return true;
+        }
+    } else {
+        if (m == 1 && n == 1) {
+            return true;
+        } else if (m == 1) {
+            *single_char_m = true;
+        } else if (n == 1) {
+            *single_char_n = true;
+        } else if (m == 2 && n == 2 && CHAR_EQUAL(s1[0], s2[1])
+                    && CHAR_EQUAL(s1[1], s2[0])
+                    && !(CHAR_EQUAL(s1[0], s1[1]))
+        ) {
+            return true;
+        }
+    }
+    return false;
+}
 
-#define CONCAT3_(a, b, c) a ## b ## c
-#define CONCAT3(a, b, c) CONCAT3_(a, b, c)
-#define HIRSCHBERG_TYPED(name) CONCAT3(hirschberg_, VALUE_NAME, _##name)
-// e.g. HIRSCHBERG_TYPED(foo) for double would = hirschberg_double_foo
+// Row split of s1 for a non-leaf subproblem: the midpoint, moved off UTF-8 continuation bytes and
+// past the border when a transposition straddles it
+static inline size_t subproblem_split_m(string_pair_input_t input, hirschberg_options_t options, string_subproblem_t sub) {
+    const char *s1 = input.s1 + sub.x;
+    const char *s2 = input.s2 + sub.y;
+    size_t m = sub.m;
+    bool utf8 = options.utf8;
 
-typedef size_t (*HIRSCHBERG_TYPED(function_standard))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size);
-typedef size_t (*HIRSCHBERG_TYPED(function_options))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, void *options);
-typedef size_t (*HIRSCHBERG_TYPED(function_varargs))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, size_t num_args, va_list args);
+    size_t sub_m = floor((double)m / 2.0);
+    if (utf8 && utf8_is_continuation(s1[sub_m])) {
+        sub_m -= utf8_prev(s1, sub_m);
+    }
+    if (options.allow_transpose) {
+        if (utf8 && subproblem_border_transpose_utf8(s1, s2, sub, sub_m)) {
+            sub_m += utf8_next(s1 + sub_m);
+        } else if (!utf8 && m > 1 && subproblem_border_transpose(s1, s2, sub, sub_m)) {
+            sub_m++;
+        }
+    }
+    return sub_m;
+}
 
-typedef struct {
-    hirschberg_value_function_type_t type;
-    union {
-        HIRSCHBERG_TYPED(function_standard) standard;
-        HIRSCHBERG_TYPED(function_options) options;
-        HIRSCHBERG_TYPED(function_varargs) varargs;
-    } func;
-    void *options;
-    size_t num_args;
-    va_list args;
-} HIRSCHBERG_TYPED(function_t);
+// Splits a subproblem at (sub_m, sub_n), making sure both halves are strictly smaller than the parent
+static inline void subproblem_split(string_pair_input_t input, bool utf8, string_subproblem_t sub,
+                                    size_t sub_m, size_t sub_n, bool single_char_m, bool single_char_n,
+                                    string_subproblem_t *left_sub, string_subproblem_t *right_sub) {
+    size_t m = sub.m;
+    size_t n = sub.n;
 
-typedef struct {
-    VALUE_TYPE *values;
-    size_t size;
-} HIRSCHBERG_TYPED(values_t);
+    if ((sub_n == 0 && sub_m == 0) || (sub_n == n && sub_m == m)){
+        if (!utf8) {
+            sub_m = 1;
+            sub_n = 1;
+        } else {
+            sub_m = utf8_next(input.s1 + sub.x);
+            sub_n = utf8_next(input.s2 + sub.y);
+        }
+    } else if (sub_m == 0 && sub_n == n && !single_char_m) {
+        if (!utf8) {
+            sub_m = 1;
+        } else {
+            sub_m = utf8_next(input.s1 + sub.x);
+        }
+    } else if (sub_n == 0 && sub_m == m && !single_char_n) {
+        if (!utf8) {
+            sub_n = 1;
+        } else {
+            sub_n = utf8_next(input.s2 + sub.y);
+        }
+    }
+
+    *left_sub = (string_subproblem_t) {
+        .x = sub.x,
+        .m = sub_m,
+        .y = sub.y,
+        .n = sub_n
+    };
+    *right_sub = (string_subproblem_t) {
+        .x = sub.x + sub_m,
+        .m = sub.m - sub_m,
+        .y = sub.y + sub_n,
+        .n = sub.n - sub_n
+    };
+}
 
+// A single replacement in one of the inputs: old_len bytes at start were replaced by new_len bytes
 typedef struct {
-    string_pair_input_t input;
-    hirschberg_options_t options;
-    HIRSCHBERG_TYPED(values_t) *values;
-    HIRSCHBERG_TYPED(function_t) *values_function;
-    string_subproblem_array *stack;
-    string_subproblem_t sub;
-    bool is_result;
-} HIRSCHBERG_TYPED(iter);
+    bool in_s2;
+    size_t start;
+    size_t old_len;
+    size_t new_len;
+} hirschberg_edit_t;
+
+// Normalized (NFC) and case-folded codepoints, prepared once when a string is loaded so that
+// comparisons in the iterator and kernels are plain integer equality. Leaves of a prepared alignment
+// are in this normalized space: x and m count codepoints of codepoints, not bytes of the source.
+// offsets maps them back: offsets[i] is the byte offset in the source string of the text codepoint i
+// was normalized from, and offsets[len] is the source length, so codepoints [x, x + m) came from
+// source bytes [offsets[x], offsets[x + m]). Codepoints composed from several source codepoints all
+// map to the start of their source run.
+typedef struct {
+    int32_t *codepoints;
+    size_t *offsets;
+    size_t len;
+} hirschberg_prepared_string_t;
 
-HIRSCHBERG_TYPED(values_t) *HIRSCHBERG_TYPED(values_new)(size_t size) {
-    HIRSCHBERG_TYPED(values_t) *self = malloc(sizeof(HIRSCHBERG_TYPED(values_t)));
+static inline void hirschberg_prepared_string_destroy(hirschberg_prepared_string_t *self) {
+    if (self == NULL) return;
+    free(self->codepoints);
+    free(self->offsets);
+    free(self);
+}
+
+// Decodes (and case-folds) len bytes of UTF-8 into at most max codepoints, returning how many were written
+static inline size_t prepared_decode(const utf8proc_uint8_t *str, size_t len, int32_t *codepoints, size_t *offsets, size_t max) {
+    size_t count = 0;
+    size_t consumed = 0;
+    while (consumed < len && count < max) {
+        int32_t ch = 0;
+        utf8proc_ssize_t ch_len = utf8proc_iterate(str + consumed, len - consumed, &ch);
+        if (ch_len <= 0) break;
+        #ifndef HIRSCHBERG_CASE_SENSITIVE
+        ch = utf8proc_tolower(ch);
+        #endif
+        codepoints[count] = ch;
+        if (offsets != NULL) offsets[count] = consumed;
+        count++;
+        consumed += ch_len;
+    }
+    return count;
+}
+
+// NFC of len bytes of str, which needn't be NUL-terminated (utf8proc_NFC needs it to be)
+static inline utf8proc_uint8_t *prepared_nfc(const char *str, size_t len) {
+    char *copy = malloc(len + 1);
+    if (copy == NULL) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    utf8proc_uint8_t *normalized = utf8proc_NFC((const utf8proc_uint8_t *)copy);
+    free(copy);
+    return normalized;
+}
+
+// Fills offsets for a string whose NFC differs from the source. The source is normalized run by
+// run, each run a starter and the non-starters after it, and a run's codepoints map to its start.
+// If a run doesn't normalize to the next codepoints of the whole-string NFC, it composed with the
+// following run (e.g. Hangul jamo), so the run is extended by another one and retried.
+static inline bool prepared_map_offsets(hirschberg_prepared_string_t *self, const char *str, size_t len) {
+    // one more than fits, so a run that normalizes past the end of the string shows up as a mismatch
+    int32_t *run = malloc(sizeof(int32_t) * (self->len + 1));
+    if (run == NULL) return false;
+    const utf8proc_uint8_t *src = (const utf8proc_uint8_t *)str;
+    size_t index = 0;
+    size_t run_start = 0;
+    size_t run_end = 0;
+    while (run_start < len && index < self->len) {
+        // extend the run to the next starter
+        int32_t ch = 0;
+        utf8proc_ssize_t ch_len = utf8proc_iterate(src + run_end, len - run_end, &ch);
+        if (ch_len <= 0) break;
+        run_end += ch_len;
+        while (run_end < len) {
+            ch_len = utf8proc_iterate(src + run_end, len - run_end, &ch);
+            if (ch_len <= 0 || utf8proc_get_property(ch)->combining_class == 0) break;
+            run_end += ch_len;
+        }
+
+        utf8proc_uint8_t *normalized = prepared_nfc(str + run_start, run_end - run_start);
+        if (normalized == NULL) {
+            free(run);
+            return false;
+        }
+        size_t run_len = prepared_decode(normalized, strlen((const char *)normalized), run, NULL, self->len + 1);
+        free(normalized);
+        if (run_end < len && (run_len > self->len - index || memcmp(run, self->codepoints + index, sizeof(int32_t) * run_len) != 0)) {
+            continue;
+        }
+        for (size_t i = 0; i < run_len && index < self->len; i++) {
+            self->offsets[index++] = run_start;
+        }
+        run_start = run_end;
+    }
+    while (index < self->len) {
+        self->offsets[index++] = run_start;
+    }
+    self->offsets[self->len] = len;
+    free(run);
+    return true;
+}
+
+static inline hirschberg_prepared_string_t *hirschberg_prepared_string_new(const char *str, size_t len, bool utf8) {
+    if (str == NULL) return NULL;
+    hirschberg_prepared_string_t *self = malloc(sizeof(hirschberg_prepared_string_t));
     if (self == NULL) return NULL;
-    VALUE_TYPE *values = malloc(sizeof(VALUE_TYPE) * 2 * size);
-    if (values == NULL) {
+    self->len = 0;
+    self->codepoints = NULL;
+    self->offsets = NULL;
+
+    if (!utf8) {
+        self->codepoints = malloc(sizeof(int32_t) * (len > 0 ? len : 1));
+        self->offsets = malloc(sizeof(size_t) * (len + 1));
+        if (self->codepoints == NULL || self->offsets == NULL) {
+            hirschberg_prepared_string_destroy(self);
+            return NULL;
+        }
+        for (size_t i = 0; i < len; i++) {
+            unsigned char c = (unsigned char)str[i];
+            #ifndef HIRSCHBERG_CASE_SENSITIVE
+            self->codepoints[i] = (int32_t)tolower(c);
+            #else
+            self->codepoints[i] = (int32_t)c;
+            #endif
+            self->offsets[i] = i;
+        }
+        self->offsets[len] = len;
+        self->len = len;
+        return self;
+    }
+
+    utf8proc_uint8_t *normalized = prepared_nfc(str, len);
+    if (normalized == NULL) {
         free(self);
         return NULL;
     }
-    self->values = values;
-    self->size = size;
+
+    // NFC never produces more codepoints than bytes
+    size_t normalized_len = strlen((const char *)normalized);
+    self->codepoints = malloc(sizeof(int32_t) * (normalized_len > 0 ? normalized_len : 1));
+    self->offsets = malloc(sizeof(size_t) * (normalized_len + 1));
+    if (self->codepoints == NULL || self->offsets == NULL) {
+        free(normalized);
+        hirschberg_prepared_string_destroy(self);
+        return NULL;
+    }
+
+    self->len = prepared_decode(normalized, normalized_len, self->codepoints, self->offsets, normalized_len);
+    // already normalized (the common case): the offsets into the NFC are the source offsets
+    bool same = normalized_len == len && memcmp(normalized, str, len) == 0;
+    free(normalized);
+    if (same) {
+        self->offsets[self->len] = len;
+    } else if (!prepared_map_offsets(self, str, len)) {
+        hirschberg_prepared_string_destroy(self);
+        return NULL;
+    }
     return self;
 }
 
-static bool HIRSCHBERG_TYPED(values_resize)(HIRSCHBERG_TYPED(values_t) *self, size_t size) {
-    if (self == NULL) return false;
-    if (size == self->size) return true;
-    VALUE_TYPE *new_values = realloc(self->values, sizeof(VALUE_TYPE) * 2 * size);
-    if (new_values == NULL) return false;
-    self->values = new_values;
-    self->size = size;
-    return true;
+static inline bool prepared_subproblem_is_result(const int32_t *s1, const int32_t *s2, string_subproblem_t sub, bool *single_char_m, bool *single_char_n) {
+    size_t m = sub.m;
+    size_t n = sub.n;
+    *single_char_m = false;
+    *single_char_n = false;
+
+    if (m == 0 || n == 0) return true;
+    if (m == 1 && n == 1) {
+        return true;
+    } else if (m == 1) {
+        *single_char_m = true;
+    } else if (n == 1) {
+        *single_char_n = true;
+    } else if (m == 2 && n == 2) {
+        const int32_t *a = s1 + sub.x;
+        const int32_t *b = s2 + sub.y;
+        if (a[0] == b[1] && a[1] == b[0] && a[0] != a[1]) return true;
+    }
+    return false;
 }
 
-static inline VALUE_TYPE *HIRSCHBERG_TYPED(forward_values)(HIRSCHBERG_TYPED(values_t) *self) {
-    if (self == NULL || self->values == NULL) return NULL;
-    return self->values;
+static inline size_t prepared_subproblem_split_m(const int32_t *s1, const int32_t *s2, hirschberg_options_t options, string_subproblem_t sub) {
+    size_t sub_m = sub.m / 2;
+    if (options.allow_transpose && sub.m > 1 && sub.n > 0 && sub_m > 0) {
+        int32_t split_left = s1[sub.x + sub_m - 1];
+        int32_t split_right = s1[sub.x + sub_m];
+        const int32_t *b = s2 + sub.y;
+        for (size_t j = 1; j < sub.n; j++) {
+            if (b[j - 1] == split_right && b[j] == split_left && b[j - 1] != b[j]) {
+                sub_m++;
+                break;
+            }
+        }
+    }
+    return sub_m;
 }
 
-static inline VALUE_TYPE *HIRSCHBERG_TYPED(reverse_values)(HIRSCHBERG_TYPED(values_t) *self) {
-    if (self == NULL || self->values == NULL) return NULL;
-    return self->values + self->size;
+// 64-bit FNV-1a, used to fingerprint inputs
+static inline uint64_t hirschberg_hash(const char *str, size_t len, uint64_t hash) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint64_t)(unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
 }
 
-static inline void HIRSCHBERG_TYPED(zero_values)(HIRSCHBERG_TYPED(values_t) *self) {
-    if (self == NULL || self->values == NULL) return;
-    memset(self->values, 0, sizeof(VALUE_TYPE) * 2 * self->size);
+#define HIRSCHBERG_HASH_SEED 14695981039346656037ULL
+
+static inline uint64_t hirschberg_input_hash(string_pair_input_t input) {
+    uint64_t hash = hirschberg_hash(input.s1, input.m, HIRSCHBERG_HASH_SEED);
+    // separate the two strings so that moving bytes from one to the other changes the hash
+    hash = hirschberg_hash((const char *)&input.m, sizeof(input.m), hash);
+    return hirschberg_hash(input.s2, input.n, hash);
 }
 
-static inline void HIRSCHBERG_TYPED(values_destroy)(HIRSCHBERG_TYPED(values_t) *self) {
-    if (self == NULL) return;
-    free(self->values);
-    free(self);
+// Serialized subproblem stacks, for checkpointing an iterator or handing subproblems to other processes.
+// Layout: "HBSS", a version byte, an options byte, then LEB128 varints for the input lengths, the
+// input hash, the x, m, y, n of the iterator's root, the score size in bytes (0 if there's no score yet)
+// followed by the score's raw bytes, the number of subproblems and the x, m, y, n of each, bottom of
+// the stack first. The score is stored in host byte order, so it only reads back into the same value
+// type on the same kind of machine. Version 1 files had no root or score and are no longer read.
+#define HIRSCHBERG_SUBPROBLEMS_MAGIC "HBSS"
+#define HIRSCHBERG_SUBPROBLEMS_VERSION 2
+
+static inline bool hirschberg_write_varint(FILE *f, uint64_t value) {
+    do {
+        unsigned char byte = value & 0x7F;
+        value >>= 7;
+        if (value != 0) byte |= 0x80;
+        if (fputc(byte, f) == EOF) return false;
+    } while (value != 0);
+    return true;
 }
 
-static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new)(HIRSCHBERG_TYPED(function_standard) standard_func) {
-    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
-    if (function == NULL) return NULL;
-    function->type = VALUE_FUNCTION_STANDARD;
-    function->func.standard = standard_func;
-    return function;
+static inline bool hirschberg_read_varint(FILE *f, uint64_t *value) {
+    uint64_t result = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(f);
+        if (c == EOF) return false;
+        result |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
 }
 
-static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new_options)(HIRSCHBERG_TYPED(function_options) options_func, void *options) {
-    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
-    if (function == NULL) return NULL;
-    function->type = VALUE_FUNCTION_OPTIONS;
-    function->func.options = options_func;
-    function->options = options;
-    return function;
+// score may be NULL when there's no score yet, score_size is the size of the value type
+static inline bool hirschberg_subproblems_write(FILE *f, string_pair_input_t input, hirschberg_options_t options,
+                                                string_subproblem_t root, const void *score, size_t score_size,
+                                                const string_subproblem_t *subs, size_t num_subs) {
+    if (f == NULL || (subs == NULL && num_subs > 0)) return false;
+    if (score == NULL) score_size = 0;
+    unsigned char flags = (options.utf8 ? 1 : 0) | (options.allow_transpose ? 2 : 0) | (options.init_values_zero ? 4 : 0);
+    if (fwrite(HIRSCHBERG_SUBPROBLEMS_MAGIC, 1, 4, f) != 4) return false;
+    if (fputc(HIRSCHBERG_SUBPROBLEMS_VERSION, f) == EOF || fputc(flags, f) == EOF) return false;
+    if (!hirschberg_write_varint(f, input.m) || !hirschberg_write_varint(f, input.n)) return false;
+    if (!hirschberg_write_varint(f, hirschberg_input_hash(input))) return false;
+    if (!hirschberg_write_varint(f, root.x) || !hirschberg_write_varint(f, root.m)
+     || !hirschberg_write_varint(f, root.y) || !hirschberg_write_varint(f, root.n)) return false;
+    if (!hirschberg_write_varint(f, score_size)) return false;
+    if (score_size > 0 && fwrite(score, 1, score_size, f) != score_size) return false;
+    if (!hirschberg_write_varint(f, num_subs)) return false;
+    for (size_t i = 0; i < num_subs; i++) {
+        string_subproblem_t sub = subs[i];
+        if (!hirschberg_write_varint(f, sub.x) || !hirschberg_write_varint(f, sub.m)
+         || !hirschberg_write_varint(f, sub.y) || !hirschberg_write_varint(f, sub.n)) return false;
+    }
+    return true;
 }
 
-static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new_varargs)(HIRSCHBERG_TYPED(function_varargs) varargs_func, size_t num_args, ...) {
-    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
-    if (function == NULL) return NULL;
-    function->type = VALUE_FUNCTION_VARARGS;
-    va_list args;
-    va_start(args, num_args);
-    function->func.varargs = varargs_func;
-    function->num_args = num_args;
-    va_copy(function->args, args);
-    va_end(args);
-    return function;
+// Reads subproblems written for the same input, appending them to subs in their original order, along
+// with the root and, if one was saved, the score (has_score tells which). Fails if the file is malformed,
+// was written for a different input, a subproblem is out of bounds or the saved score isn't score_size
+// bytes (a different value type).
+static inline bool hirschberg_subproblems_read(FILE *f, string_pair_input_t input, hirschberg_options_t *options,
+                                               string_subproblem_t *root, void *score, size_t score_size, bool *has_score,
+                                               string_subproblem_array *subs) {
+    if (f == NULL || options == NULL || root == NULL || score == NULL || has_score == NULL || subs == NULL) return false;
+    char magic[4];
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, HIRSCHBERG_SUBPROBLEMS_MAGIC, 4) != 0) return false;
+    int version = fgetc(f);
+    int flags = fgetc(f);
+    if (version != HIRSCHBERG_SUBPROBLEMS_VERSION || flags == EOF) return false;
+
+    uint64_t m, n, hash, num_subs;
+    if (!hirschberg_read_varint(f, &m) || !hirschberg_read_varint(f, &n) || !hirschberg_read_varint(f, &hash)) return false;
+    if (m != input.m || n != input.n || hash != hirschberg_input_hash(input)) return false;
+
+    uint64_t root_x, root_m, root_y, root_n, stored_size;
+    if (!hirschberg_read_varint(f, &root_x) || !hirschberg_read_varint(f, &root_m)
+     || !hirschberg_read_varint(f, &root_y) || !hirschberg_read_varint(f, &root_n)) return false;
+    if (root_x > m || root_m > m - root_x || root_y > n || root_n > n - root_y) return false;
+    if (!hirschberg_read_varint(f, &stored_size)) return false;
+    if (stored_size != 0 && stored_size != score_size) return false;
+    if (stored_size > 0 && fread(score, 1, score_size, f) != score_size) return false;
+    if (!hirschberg_read_varint(f, &num_subs)) return false;
+
+    for (uint64_t i = 0; i < num_subs; i++) {
+        uint64_t x, sub_m, y, sub_n;
+        if (!hirschberg_read_varint(f, &x) || !hirschberg_read_varint(f, &sub_m)
+         || !hirschberg_read_varint(f, &y) || !hirschberg_read_varint(f, &sub_n)) return false;
+        if (x > m || sub_m > m - x || y > n || sub_n > n - y) return false;
+        string_subproblem_array_push(subs, (string_subproblem_t) {
+            .x = (size_t)x,
+            .m = (size_t)sub_m,
+            .y = (size_t)y,
+            .n = (size_t)sub_n
+        });
+    }
+
+    options->utf8 = (flags & 1) != 0;
+    options->allow_transpose = (flags & 2) != 0;
+    options->init_values_zero = (flags & 4) != 0;
+    *root = (string_subproblem_t) {
+        .x = (size_t)root_x,
+        .m = (size_t)root_m,
+        .y = (size_t)root_y,
+        .n = (size_t)root_n
+    };
+    *has_score = stored_size > 0;
+    return true;
 }
 
-HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new)(string_pair_input_t input,
-                                                   hirschberg_options_t options,
-                                                   HIRSCHBERG_TYPED(values_t) *values,
-                                                   HIRSCHBERG_TYPED(function_t) *values_function) {
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t insertions;
+    size_t evictions;
+} hirschberg_cache_stats_t;
+
+#define HIRSCHBERG_CACHE_NONE SIZE_MAX
+
+typedef enum {
+    HIRSCHBERG_CACHE_KERNEL_STANDARD,
+    HIRSCHBERG_CACHE_KERNEL_OPTIONS,
+    HIRSCHBERG_CACHE_KERNEL_VARARGS,
+    HIRSCHBERG_CACHE_KERNEL_PREPARED,
+    HIRSCHBERG_CACHE_KERNEL_LANES
+} hirschberg_cache_kernel_t;
+
+// Four-Russians lookup tables for unit-cost LCS or Levenshtein over a small alphabet.
+// Every t x t block of the DP is described by its s1 and s2 characters and the offsets (-1, 0, +1)
+// between adjacent cells along its top row and left column, and the table maps those to the offsets
+// along its bottom row and right column. Tables are read-only once built and can be shared across threads.
+typedef enum {
+    HIRSCHBERG_FOUR_RUSSIANS_LCS,
+    HIRSCHBERG_FOUR_RUSSIANS_LEVENSHTEIN
+} hirschberg_four_russians_model_t;
+
+// A table has (3 * sigma)^(2t) entries of 2 bytes for an alphabet of sigma characters, and
+// hirschberg_four_russians_new returns NULL above HIRSCHBERG_FOUR_RUSSIANS_MAX_ENTRIES (128 MiB of
+// table by default). With the default cap, t = 4 fits alphabets of up to 3 characters, t = 3 up to 6
+// (DNA's 4 letters included), and t = 2 up to 30.
+#ifndef HIRSCHBERG_FOUR_RUSSIANS_MAX_ENTRIES
+#define HIRSCHBERG_FOUR_RUSSIANS_MAX_ENTRIES (1 << 26)
+#endif
+
+#define HIRSCHBERG_FOUR_RUSSIANS_MAX_T 4
+
+typedef struct {
+    hirschberg_four_russians_model_t model;
+    size_t t;
+    size_t sigma;
+    size_t sigma_t;
+    size_t pow3_t;
+    int16_t alphabet_map[256];
+    // (bottom offsets code) * 3^t + (right offsets code), offsets encoded as base-3 digits of offset + 1
+    uint16_t *table;
+} hirschberg_four_russians_t;
+
+static inline int four_russians_cell(hirschberg_four_russians_model_t model, int diag, int up, int left, bool eq) {
+    if (model == HIRSCHBERG_FOUR_RUSSIANS_LCS) {
+        if (eq) return diag + 1;
+        return up > left ? up : left;
+    }
+    int best = (up < left ? up : left) + 1;
+    int sub = diag + (eq ? 0 : 1);
+    return sub < best ? sub : best;
+}
+
+static inline hirschberg_four_russians_t *hirschberg_four_russians_new(const char *alphabet, size_t t, hirschberg_four_russians_model_t model) {
+    if (alphabet == NULL || t == 0 || t > HIRSCHBERG_FOUR_RUSSIANS_MAX_T) return NULL;
+    size_t sigma = strlen(alphabet);
+    if (sigma == 0) return NULL;
+
+    size_t sigma_t = 1;
+    size_t pow3_t = 1;
+    for (size_t k = 0; k < t; k++) {
+        sigma_t *= sigma;
+        pow3_t *= 3;
+        if (sigma_t > HIRSCHBERG_FOUR_RUSSIANS_MAX_ENTRIES) return NULL;
+    }
+    size_t num_entries = sigma_t * sigma_t;
+    if (num_entries > HIRSCHBERG_FOUR_RUSSIANS_MAX_ENTRIES / (pow3_t * pow3_t)) return NULL;
+    num_entries *= pow3_t * pow3_t;
+
+    hirschberg_four_russians_t *self = malloc(sizeof(hirschberg_four_russians_t));
+    if (self == NULL) return NULL;
+    self->table = malloc(sizeof(uint16_t) * num_entries);
+    if (self->table == NULL) {
+        free(self);
+        return NULL;
+    }
+    self->model = model;
+    self->t = t;
+    self->sigma = sigma;
+    self->sigma_t = sigma_t;
+    self->pow3_t = pow3_t;
+
+    for (size_t c = 0; c < 256; c++) {
+        self->alphabet_map[c] = -1;
+        for (size_t k = 0; k < sigma; k++) {
+            if (CHAR_EQUAL((int)c, (unsigned char)alphabet[k])) {
+                self->alphabet_map[c] = (int16_t)k;
+                break;
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(static) if (num_entries > OMP_PARALLEL_MIN_SIZE)
+    for (size_t idx = 0; idx < num_entries; idx++) {
+        int d[HIRSCHBERG_FOUR_RUSSIANS_MAX_T + 1][HIRSCHBERG_FOUR_RUSSIANS_MAX_T + 1];
+        size_t a[HIRSCHBERG_FOUR_RUSSIANS_MAX_T];
+        size_t b[HIRSCHBERG_FOUR_RUSSIANS_MAX_T];
+        size_t rest = idx;
+        size_t left_code = rest % pow3_t;
+        rest /= pow3_t;
+        size_t top_code = rest % pow3_t;
+        rest /= pow3_t;
+        size_t s2_code = rest % sigma_t;
+        size_t s1_code = rest / sigma_t;
+
+        d[0][0] = 0;
+        for (size_t k = 0; k < t; k++) {
+            a[k] = s1_code % sigma;
+            s1_code /= sigma;
+            b[k] = s2_code % sigma;
+            s2_code /= sigma;
+            d[0][k + 1] = d[0][k] + (int)(top_code % 3) - 1;
+            top_code /= 3;
+            d[k + 1][0] = d[k][0] + (int)(left_code % 3) - 1;
+            left_code /= 3;
+        }
+        for (size_t i = 1; i <= t; i++) {
+            for (size_t j = 1; j <= t; j++) {
+                d[i][j] = four_russians_cell(model, d[i - 1][j - 1], d[i - 1][j], d[i][j - 1], a[i - 1] == b[j - 1]);
+            }
+        }
+
+        size_t bottom_code = 0;
+        size_t right_code = 0;
+        for (size_t k = t; k > 0; k--) {
+            // offsets of impossible boundaries can leave the -1..+1 range, clamp them since they never occur in practice
+            int bottom = d[t][k] - d[t][k - 1];
+            int right = d[k][t] - d[k - 1][t];
+            bottom = bottom < -1 ? -1 : (bottom > 1 ? 1 : bottom);
+            right = right < -1 ? -1 : (right > 1 ? 1 : right);
+            bottom_code = bottom_code * 3 + (size_t)(bottom + 1);
+            right_code = right_code * 3 + (size_t)(right + 1);
+        }
+        self->table[idx] = (uint16_t)(bottom_code * pow3_t + right_code);
+    }
+    return self;
+}
+
+static inline void hirschberg_four_russians_destroy(hirschberg_four_russians_t *self) {
+    if (self == NULL) return;
+    free(self->table);
+    free(self);
+}
+
+// Whether every byte of str is in the table's alphabet. The kernel fails on any other character, which
+// stops the iterator, so check inputs with this before aligning them with the table.
+static inline bool hirschberg_four_russians_accepts(const hirschberg_four_russians_t *self, const char *str, size_t len) {
+    if (self == NULL || (str == NULL && len > 0)) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (self->alphabet_map[(unsigned char)str[i]] < 0) return false;
+    }
+    return true;
+}
+
+// Tiled row kernels sweep the DP in column strips of strip_width columns (0 picks the widest strip
+// whose row segment fits in half of HIRSCHBERG_L2_CACHE_SIZE), passing only the boundary column
+// between strips
+#ifndef HIRSCHBERG_L2_CACHE_SIZE
+#define HIRSCHBERG_L2_CACHE_SIZE (256 * 1024)
+#endif
+
+typedef struct {
+    size_t strip_width;
+} hirschberg_tiled_options_t;
+
+// Lower-bound pre-filter for batches of pairs. A pair is discarded when one of these proves that its
+// unit-cost edit distance is above max_distance:
+//   - length: the distance is at least the difference in lengths
+//   - histogram: it's at least the larger of the characters s1 has in excess of s2 and vice versa
+//   - q-grams: each edit destroys at most q of s1's q-grams (q + 1 for a transposition), so the pair
+//     must share at least max(m, n) - q + 1 - max_distance * q of them
+// Characters are codepoints when options.utf8 is set and are case-folded like CHAR_EQUAL. Both counts
+// are kept in hashed bins, which can only overestimate what the strings share, so no pair within
+// max_distance is ever discarded. The bounds hold for any cost function whose edits all cost at least 1.
+#define HIRSCHBERG_FILTER_HISTOGRAM_BINS 256
+#define HIRSCHBERG_FILTER_QGRAM_BINS 4096
+#define HIRSCHBERG_FILTER_MAX_Q 8
+
+static inline int32_t hirschberg_filter_fold(int32_t c, bool utf8) {
+    #ifndef HIRSCHBERG_CASE_SENSITIVE
+    return utf8 ? utf8proc_tolower(c) : tolower(c);
+    #else
+    return c;
+    #endif
+}
+
+// Next character of str starting at *pos, or -1 on invalid UTF-8
+static inline int32_t hirschberg_filter_next(const char *str, size_t len, size_t *pos, bool utf8) {
+    if (!utf8) return hirschberg_filter_fold((unsigned char)str[(*pos)++], false);
+    int32_t ch = 0;
+    utf8proc_ssize_t ch_len = utf8proc_iterate((const uint8_t *)str + *pos, (utf8proc_ssize_t)(len - *pos), &ch);
+    if (ch_len <= 0) return -1;
+    *pos += (size_t)ch_len;
+    return hirschberg_filter_fold(ch, true);
+}
+
+static inline size_t hirschberg_filter_len(const char *str, size_t len, bool utf8) {
+    if (!utf8) return len;
+    size_t num_chars = 0;
+    #pragma omp simd reduction(+:num_chars)
+    for (size_t i = 0; i < len; i++) {
+        num_chars += !utf8_is_continuation(str[i]);
+    }
+    return num_chars;
+}
+
+static inline size_t hirschberg_filter_histogram_bin(int32_t c) {
+    // ASCII gets its own bins
+    return ((uint32_t)c ^ ((uint32_t)c >> 8)) & (HIRSCHBERG_FILTER_HISTOGRAM_BINS - 1);
+}
+
+static inline size_t hirschberg_filter_qgram_bin(const int32_t *window, size_t start, size_t q) {
+    uint64_t hash = HIRSCHBERG_HASH_SEED;
+    for (size_t k = 0; k < q; k++) {
+        hash = (hash ^ (uint32_t)window[(start + k) % q]) * 0x100000001b3ULL;
+    }
+    return (size_t)(hash ^ (hash >> 32)) & (HIRSCHBERG_FILTER_QGRAM_BINS - 1);
+}
+
+// Adds (sign = 1) or removes (sign = -1) the characters of str from the histogram. s1's q-grams are
+// counted into qgram_counts, s2's are matched against them into shared, and with sign = -1 and no
+// shared the bins of s1 are reset. Returns false on invalid UTF-8.
+static inline bool hirschberg_filter_scan(const char *str, size_t len, bool utf8, size_t q, int32_t sign,
+                                          int32_t *histogram, uint32_t *qgram_counts, size_t *shared) {
+    int32_t window[HIRSCHBERG_FILTER_MAX_Q];
+    size_t num_chars = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        int32_t c = hirschberg_filter_next(str, len, &pos, utf8);
+        if (c < 0) return false;
+        if (histogram != NULL) histogram[hirschberg_filter_histogram_bin(c)] += sign;
+        if (q == 0) continue;
+        window[num_chars % q] = c;
+        num_chars++;
+        if (num_chars < q) continue;
+        size_t bin = hirschberg_filter_qgram_bin(window, num_chars % q, q);
+        if (sign > 0) {
+            qgram_counts[bin]++;
+        } else if (shared == NULL) {
+            // reset the bins s1 used so the counts can be reused by the next pair
+            qgram_counts[bin] = 0;
+        } else if (qgram_counts[bin] > 0) {
+            qgram_counts[bin]--;
+            (*shared)++;
+        }
+    }
+    return true;
+}
+
+// qgram_counts must hold HIRSCHBERG_FILTER_QGRAM_BINS zeros and is left zeroed
+static inline bool hirschberg_filter_pair_counts(string_pair_input_t pair, hirschberg_options_t options, size_t max_distance,
+                                                 size_t q, uint32_t *qgram_counts) {
+    bool utf8 = options.utf8;
+    size_t m = hirschberg_filter_len(pair.s1, pair.m, utf8);
+    size_t n = hirschberg_filter_len(pair.s2, pair.n, utf8);
+    size_t max_len = m > n ? m : n;
+    size_t len_diff = m > n ? m - n : n - m;
+    if (len_diff > max_distance) return false;
+    if (max_distance >= max_len) return true;
+
+    if (q > HIRSCHBERG_FILTER_MAX_Q) q = HIRSCHBERG_FILTER_MAX_Q;
+    // too few q-grams to bound anything
+    if (q > 0 && max_len < q + max_distance * q) q = 0;
+
+    int32_t histogram[HIRSCHBERG_FILTER_HISTOGRAM_BINS] = {0};
+    size_t shared = 0;
+    bool valid = hirschberg_filter_scan(pair.s1, pair.m, utf8, q, 1, histogram, qgram_counts, NULL)
+              && hirschberg_filter_scan(pair.s2, pair.n, utf8, q, -1, histogram, qgram_counts, &shared);
+    if (q > 0) {
+        hirschberg_filter_scan(pair.s1, pair.m, utf8, q, -1, NULL, qgram_counts, NULL);
+    }
+    // be conservative with strings the aligner would have to guess about
+    if (!valid) return true;
+
+    size_t excess_s1 = 0;
+    size_t excess_s2 = 0;
+    #pragma omp simd reduction(+:excess_s1, excess_s2)
+    for (size_t i = 0; i < HIRSCHBERG_FILTER_HISTOGRAM_BINS; i++) {
+        int32_t d = histogram[i];
+        excess_s1 += (size_t)(d > 0 ? d : 0);
+        excess_s2 += (size_t)(d < 0 ? -d : 0);
+    }
+    if (excess_s1 > max_distance || excess_s2 > max_distance) return false;
+
+    if (q > 0) {
+        size_t per_edit = options.allow_transpose ? q + 1 : q;
+        if (shared + max_distance * per_edit < max_len - q + 1) return false;
+    }
+    return true;
+}
+
+// True if the pair may be within max_distance. q = 0 skips the q-gram filter.
+static inline bool hirschberg_filter_pair(string_pair_input_t pair, hirschberg_options_t options, size_t max_distance, size_t q) {
+    uint32_t *qgram_counts = calloc(HIRSCHBERG_FILTER_QGRAM_BINS, sizeof(uint32_t));
+    if (qgram_counts == NULL) return true;
+    bool keep = hirschberg_filter_pair_counts(pair, options, max_distance, q, qgram_counts);
+    free(qgram_counts);
+    return keep;
+}
+
+// Filters a batch, writing the pairs that may be within max_distance to survivors (and their indices
+// in pairs to survivor_indices if not NULL) in their original order. Returns the number of survivors.
+// If memory runs out, pairs are kept rather than dropped, so at worst everything survives unfiltered.
+static size_t hirschberg_filter_pairs(const string_pair_input_t *pairs, size_t num_pairs, hirschberg_options_t options,
+                                      size_t max_distance, size_t q, string_pair_input_t *survivors, size_t *survivor_indices) {
+    if (pairs == NULL || num_pairs == 0) return 0;
+    bool *keep = malloc(sizeof(bool) * num_pairs);
+    if (keep == NULL) {
+        for (size_t i = 0; i < num_pairs; i++) {
+            if (survivors != NULL) survivors[i] = pairs[i];
+            if (survivor_indices != NULL) survivor_indices[i] = i;
+        }
+        return num_pairs;
+    }
+    for (size_t i = 0; i < num_pairs; i++) {
+        keep[i] = true;
+    }
+
+    #pragma omp parallel if (num_pairs > OMP_PARALLEL_MIN_SIZE)
+    {
+        uint32_t *qgram_counts = calloc(HIRSCHBERG_FILTER_QGRAM_BINS, sizeof(uint32_t));
+        #pragma omp for schedule(dynamic, 64)
+        for (size_t i = 0; i < num_pairs; i++) {
+            if (qgram_counts != NULL) {
+                keep[i] = hirschberg_filter_pair_counts(pairs[i], options, max_distance, q, qgram_counts);
+            }
+        }
+        free(qgram_counts);
+    }
+
+    size_t num_survivors = 0;
+    for (size_t i = 0; i < num_pairs; i++) {
+        if (!keep[i]) continue;
+        if (survivors != NULL) survivors[num_survivors] = pairs[i];
+        if (survivor_indices != NULL) survivor_indices[num_survivors] = i;
+        num_survivors++;
+    }
+    free(keep);
+    return num_survivors;
+}
+
+#endif // HIRSCHBERG_H
+
+#ifndef VALUE_TYPE
+#error "Must define VALUE_TYPE"
+#endif
+
+#ifndef VALUE_NAME
+#error "Must define VALUE_NAME"
+#endif
+
+#if !defined(HIRSCHBERG_SIMILARITY) && !defined(MAX_VALUE)
+#error "Must define MAX_VALUE for distance functions"
+#endif
+
+#define CONCAT3_(a, b, c) a ## b ## c
+#define CONCAT3(a, b, c) CONCAT3_(a, b, c)
+#define HIRSCHBERG_TYPED(name) CONCAT3(hirschberg_, VALUE_NAME, _##name)
+// e.g. HIRSCHBERG_TYPED(foo) for double would = hirschberg_double_foo
+
+typedef size_t (*HIRSCHBERG_TYPED(function_standard))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size);
+typedef size_t (*HIRSCHBERG_TYPED(function_options))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, void *options);
+typedef size_t (*HIRSCHBERG_TYPED(function_varargs))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, size_t num_args, va_list args);
+// Kernel over prepared strings: s1 and s2 are already normalized and case-folded, m and n count codepoints
+typedef size_t (*HIRSCHBERG_TYPED(function_prepared))(const int32_t *s1, size_t m, const int32_t *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size);
+
+// Optional fused reverse pass. Receives the forward row and computes the reverse pass over (s1, m) and (s2, n)
+// in the scratch values (the reverse half of values_t, values_size long), returning the offset into s2 of the best
+// split column (in bytes if utf8, rightmost on ties) and writing the combined score to opt_value. The reverse row
+// is combined with the forward row as it's finished instead of being written out whole and re-read by a separate
+// selection pass, so the scratch only has to hold the kernel's own working set, e.g. a single row updated in place
+// (see values_new_split). Since the reverse pass consumes the forward row, the two passes run one after the other
+// and a fused kernel gives up the two-thread forward/reverse sections used for large subproblems.
+// Set on a prepared kernel, s1 and s2 point at the int32_t codepoints of the prepared strings.
+typedef size_t (*HIRSCHBERG_TYPED(function_split))(const char *s1, size_t m, const char *s2, size_t n, const VALUE_TYPE *forward_values, size_t forward_size, VALUE_TYPE *values, size_t values_size, VALUE_TYPE *opt_value, void *options);
+
+typedef struct {
+    hirschberg_value_function_type_t type;
+    union {
+        HIRSCHBERG_TYPED(function_standard) standard;
+        HIRSCHBERG_TYPED(function_options) options;
+        HIRSCHBERG_TYPED(function_varargs) varargs;
+        HIRSCHBERG_TYPED(function_prepared) prepared;
+    } func;
+    HIRSCHBERG_TYPED(function_split) split;
+    void *options;
+    size_t num_args;
+    va_list args;
+    // caller-given identity of the options or varargs, see function_set_cache_id
+    uint64_t cache_id;
+    bool has_cache_id;
+} HIRSCHBERG_TYPED(function_t);
+
+typedef struct {
+    VALUE_TYPE *values;
+    size_t size;
+    // length of the reverse half, equal to size unless allocated with values_new_split
+    size_t scratch_size;
+} HIRSCHBERG_TYPED(values_t);
+
+typedef struct {
+    string_pair_input_t input;
+    const hirschberg_prepared_string_t *prepared_s1;
+    const hirschberg_prepared_string_t *prepared_s2;
+    hirschberg_options_t options;
+    HIRSCHBERG_TYPED(values_t) *values;
+    HIRSCHBERG_TYPED(function_t) *values_function;
+    string_subproblem_array *stack;
+    string_subproblem_t sub;
+    bool is_result;
+    // the first subproblem pushed; its best split score is the score of the whole alignment
+    string_subproblem_t root;
+    VALUE_TYPE score;
+    bool has_score;
+    // set when a kernel pass fails; the iterator stops early and its leaves are incomplete
+    bool failed;
+} HIRSCHBERG_TYPED(iter);
+
+// Values for kernels with a fused split: size values for the forward pass and only scratch_size for
+// the reverse pass, whatever the split function needs (n + 1 for a single-row reverse pass)
+HIRSCHBERG_TYPED(values_t) *HIRSCHBERG_TYPED(values_new_split)(size_t size, size_t scratch_size) {
+    HIRSCHBERG_TYPED(values_t) *self = malloc(sizeof(HIRSCHBERG_TYPED(values_t)));
+    if (self == NULL) return NULL;
+    VALUE_TYPE *values = malloc(sizeof(VALUE_TYPE) * (size + scratch_size));
+    if (values == NULL) {
+        free(self);
+        return NULL;
+    }
+    self->values = values;
+    self->size = size;
+    self->scratch_size = scratch_size;
+    return self;
+}
+
+HIRSCHBERG_TYPED(values_t) *HIRSCHBERG_TYPED(values_new)(size_t size) {
+    return HIRSCHBERG_TYPED(values_new_split)(size, size);
+}
+
+// Resizes the forward half, and the reverse half with it unless it was allocated as separate scratch
+static bool HIRSCHBERG_TYPED(values_resize)(HIRSCHBERG_TYPED(values_t) *self, size_t size) {
+    if (self == NULL) return false;
+    if (size == self->size) return true;
+    size_t scratch_size = self->scratch_size == self->size ? size : self->scratch_size;
+    VALUE_TYPE *new_values = realloc(self->values, sizeof(VALUE_TYPE) * (size + scratch_size));
+    if (new_values == NULL) return false;
+    self->values = new_values;
+    self->size = size;
+    self->scratch_size = scratch_size;
+    return true;
+}
+
+static inline VALUE_TYPE *HIRSCHBERG_TYPED(forward_values)(HIRSCHBERG_TYPED(values_t) *self) {
+    if (self == NULL || self->values == NULL) return NULL;
+    return self->values;
+}
+
+static inline VALUE_TYPE *HIRSCHBERG_TYPED(reverse_values)(HIRSCHBERG_TYPED(values_t) *self) {
+    if (self == NULL || self->values == NULL) return NULL;
+    return self->values + self->size;
+}
+
+static inline void HIRSCHBERG_TYPED(zero_values)(HIRSCHBERG_TYPED(values_t) *self) {
+    if (self == NULL || self->values == NULL) return;
+    memset(self->values, 0, sizeof(VALUE_TYPE) * (self->size + self->scratch_size));
+}
+
+static inline void HIRSCHBERG_TYPED(values_destroy)(HIRSCHBERG_TYPED(values_t) *self) {
+    if (self == NULL) return;
+    free(self->values);
+    free(self);
+}
+
+static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new)(HIRSCHBERG_TYPED(function_standard) standard_func) {
+    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
+    if (function == NULL) return NULL;
+    function->type = VALUE_FUNCTION_STANDARD;
+    function->split = NULL;
+    function->cache_id = 0;
+    function->has_cache_id = false;
+    function->options = NULL;
+    function->func.standard = standard_func;
+    return function;
+}
+
+static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new_options)(HIRSCHBERG_TYPED(function_options) options_func, void *options) {
+    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
+    if (function == NULL) return NULL;
+    function->type = VALUE_FUNCTION_OPTIONS;
+    function->split = NULL;
+    function->cache_id = 0;
+    function->has_cache_id = false;
+    function->func.options = options_func;
+    function->options = options;
+    return function;
+}
+
+static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new_varargs)(HIRSCHBERG_TYPED(function_varargs) varargs_func, size_t num_args, ...) {
+    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
+    if (function == NULL) return NULL;
+    function->type = VALUE_FUNCTION_VARARGS;
+    function->split = NULL;
+    function->cache_id = 0;
+    function->has_cache_id = false;
+    function->options = NULL;
+    va_list args;
+    va_start(args, num_args);
+    function->func.varargs = varargs_func;
+    function->num_args = num_args;
+    va_copy(function->args, args);
+    va_end(args);
+    return function;
+}
+
+static HIRSCHBERG_TYPED(function_t) *HIRSCHBERG_TYPED(function_new_prepared)(HIRSCHBERG_TYPED(function_prepared) prepared_func) {
+    HIRSCHBERG_TYPED(function_t) *function = malloc(sizeof(HIRSCHBERG_TYPED(function_t)));
+    if (function == NULL) return NULL;
+    function->type = VALUE_FUNCTION_PREPARED;
+    function->split = NULL;
+    function->cache_id = 0;
+    function->has_cache_id = false;
+    function->options = NULL;
+    function->func.prepared = prepared_func;
+    return function;
+}
+
+static inline void HIRSCHBERG_TYPED(function_set_split)(HIRSCHBERG_TYPED(function_t) *function, HIRSCHBERG_TYPED(function_split) split_func) {
+    if (function == NULL) return;
+    function->split = split_func;
+}
+
+// Identifies what the kernel's options or varargs mean, for the result cache. Pointers can't: a freed
+// options struct's address gets reused and a va_list can't be compared, so kernels with non-NULL
+// options or varargs are only cached once they have an id. Use a different id whenever the values differ.
+static inline void HIRSCHBERG_TYPED(function_set_cache_id)(HIRSCHBERG_TYPED(function_t) *function, uint64_t cache_id) {
+    if (function == NULL) return;
+    function->cache_id = cache_id;
+    function->has_cache_id = true;
+}
+
+static inline size_t HIRSCHBERG_TYPED(function_call)(HIRSCHBERG_TYPED(function_t) *values_function, const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_len) {
+    if (values_function->type == VALUE_FUNCTION_STANDARD) {
+        return values_function->func.standard(s1, m, s2, n, reverse, values, values_len);
+    } else if (values_function->type == VALUE_FUNCTION_OPTIONS) {
+        return values_function->func.options(s1, m, s2, n, reverse, values, values_len, values_function->options);
+    } else if (values_function->type == VALUE_FUNCTION_VARARGS) {
+        va_list args;
+        va_copy(args, values_function->args);
+        size_t size_used = values_function->func.varargs(s1, m, s2, n, reverse, values, values_len, values_function->num_args, args);
+        va_end(args);
+        return size_used;
+    } else if (values_function->type == VALUE_FUNCTION_PREPARED) {
+        // s1 and s2 are the codepoint arrays of prepared strings, passed through as char pointers
+        return values_function->func.prepared((const int32_t *)(const void *)s1, m, (const int32_t *)(const void *)s2, n, reverse, values, values_len);
+    }
+    return 0;
+}
+
+// IMPROVES encodes whether to maximize similarity or minimize distance
+#ifdef HIRSCHBERG_SIMILARITY
+#define IMPROVES >
+#define WORST_VALUE ((VALUE_TYPE) 0)
+#else
+#define IMPROVES <
+#define WORST_VALUE ((VALUE_TYPE) MAX_VALUE)
+#endif
+
+#ifndef VALUE_EQUALS
+#define VALUE_EQUALS_DEFINED
+#define VALUE_EQUALS(a, b) ((a) == (b))
+#endif
+
+// Best column for the split (rightmost on ties). Like row_best it starts from column 0 rather than
+// WORST_VALUE, which is 0 for similarity and would never let a negative sum through.
+static inline size_t HIRSCHBERG_TYPED(split_select)(const VALUE_TYPE *forward_values, const VALUE_TYPE *reverse_values, size_t size_used, const char *s2, bool utf8, VALUE_TYPE *opt_value) {
+    size_t sub_n = 0;
+    VALUE_TYPE opt_sum = WORST_VALUE;
+
+    if (utf8) {
+        const char *s2_ptr = s2;
+        size_t s2_consumed = 0;
+        for (size_t j = 0; j < size_used; j++) {
+            size_t c_len = utf8_next(s2_ptr);
+            VALUE_TYPE rev_value = reverse_values[size_used - j - 1];
+            VALUE_TYPE forward_value = forward_values[j];
+            VALUE_TYPE value = forward_value + rev_value;
+            if (j == 0 || value IMPROVES opt_sum || (VALUE_EQUALS(value, opt_sum))) {
+                sub_n = s2_consumed;
+                opt_sum = value;
+            }
+            s2_consumed += c_len;
+            s2_ptr += c_len;
+        }
+    } else {
+        for (size_t j = 0; j < size_used; j++) {
+            VALUE_TYPE forward_value = forward_values[j];
+            VALUE_TYPE rev_value = reverse_values[size_used - j - 1];
+            VALUE_TYPE value = forward_value + rev_value;
+            if (j == 0 || value IMPROVES opt_sum || (VALUE_EQUALS(value, opt_sum))) {
+                sub_n = j;
+                opt_sum = value;
+            }
+        }
+    }
+    if (opt_value != NULL) *opt_value = opt_sum;
+    return sub_n;
+}
+
+// Iterates over the alignment of a sub-rectangle of the input only. Subproblem coordinates
+// remain absolute offsets into input.s1 and input.s2.
+HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new_window)(string_pair_input_t input,
+                                                          hirschberg_options_t options,
+                                                          HIRSCHBERG_TYPED(values_t) *values,
+                                                          HIRSCHBERG_TYPED(function_t) *values_function,
+                                                          string_subproblem_t window) {
     if (values == NULL || values_function == NULL) return NULL;
+    if (window.x + window.m > input.m || window.y + window.n > input.n) return NULL;
     HIRSCHBERG_TYPED(iter) *iter = malloc(sizeof(HIRSCHBERG_TYPED(iter)));
     if (iter == NULL) return NULL;
     string_subproblem_array *stack = string_subproblem_array_new();
@@ -279,260 +1225,1770 @@ HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new)(string_pair_input_t input,
     }
 
     iter->input = input;
+    iter->prepared_s1 = NULL;
+    iter->prepared_s2 = NULL;
     iter->options = options;
     iter->values = values;
     iter->values_function = values_function;
     iter->stack = stack;
     iter->sub = NULL_SUBPROBLEM;
     iter->is_result = false;
+    iter->root = window;
+    iter->score = WORST_VALUE;
+    iter->has_score = false;
+    iter->failed = false;
+
+    if (window.m > 0 || window.n > 0) {
+        string_subproblem_array_push(iter->stack, window);
+    }
+    return iter;
+}
 
-    string_subproblem_array_push(iter->stack, (string_subproblem_t) {
+HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new)(string_pair_input_t input,
+                                                   hirschberg_options_t options,
+                                                   HIRSCHBERG_TYPED(values_t) *values,
+                                                   HIRSCHBERG_TYPED(function_t) *values_function) {
+    return HIRSCHBERG_TYPED(iter_new_window)(input, options, values, values_function, (string_subproblem_t) {
         .x = 0,
         .m = input.m,
         .y = 0,
         .n = input.n
     });
+}
+
+// Best column of a single row, as the number of bytes of s2 it covers: from the start of s2 for a forward
+// row, from the end of s2 for a reverse row. Ties go to the smallest column.
+static inline size_t HIRSCHBERG_TYPED(row_best)(const VALUE_TYPE *row_values, size_t size_used, const char *s2, size_t n, bool utf8, bool reverse, VALUE_TYPE *opt_value) {
+    size_t best = 0;
+    VALUE_TYPE opt = WORST_VALUE;
+    size_t consumed = 0;
+    for (size_t j = 0; j < size_used; j++) {
+        VALUE_TYPE value = row_values[j];
+        if (j == 0 || value IMPROVES opt) {
+            opt = value;
+            best = consumed;
+        }
+        if (consumed >= n) break;
+        if (!utf8) {
+            consumed++;
+        } else if (!reverse) {
+            consumed += utf8_next(s2 + consumed);
+        } else {
+            consumed += utf8_prev(s2, n - consumed);
+        }
+    }
+    if (opt_value != NULL) *opt_value = opt;
+    return best;
+}
+
+// Semi-global (fitting) alignment of s1 inside s2 with free end gaps in s2. fitting_function is a regular
+// kernel whose first row costs nothing (e.g. all zeros for edit distance), so its last row gives the
+// best end of s1 in s2. A reverse pass over the text up to that end gives the start. Once both ends are
+// fixed, the fitting alignment is the global alignment of s1 against the window, so the iterator's usual
+// split selection applies unchanged inside it.
+static bool HIRSCHBERG_TYPED(fitting_window)(string_pair_input_t input, hirschberg_options_t options,
+                                             HIRSCHBERG_TYPED(values_t) *values,
+                                             HIRSCHBERG_TYPED(function_t) *fitting_function,
+                                             string_subproblem_t *window, VALUE_TYPE *score) {
+    if (values == NULL || fitting_function == NULL || window == NULL) return false;
+    if (fitting_function->type > VALUE_FUNCTION_VARARGS) return false;
+    *window = NULL_SUBPROBLEM;
+    if (input.m == 0 || input.n == 0) return false;
+
+    bool utf8 = options.utf8;
+    VALUE_TYPE *forward_values = HIRSCHBERG_TYPED(forward_values)(values);
+    size_t values_len = values->size;
+
+    if (options.init_values_zero) {
+        HIRSCHBERG_TYPED(zero_values)(values);
+    }
+    size_t size_used = HIRSCHBERG_TYPED(function_call)(fitting_function, input.s1, input.m, input.s2, input.n, false, forward_values, values_len);
+    if (size_used == 0) return false;
+    size_t end_n = HIRSCHBERG_TYPED(row_best)(forward_values, size_used, input.s2, input.n, utf8, false, score);
+
+    if (options.init_values_zero) {
+        HIRSCHBERG_TYPED(zero_values)(values);
+    }
+    size_used = HIRSCHBERG_TYPED(function_call)(fitting_function, input.s1, input.m, input.s2, end_n, true, forward_values, values_len);
+    if (size_used == 0) return false;
+    size_t start_len = HIRSCHBERG_TYPED(row_best)(forward_values, size_used, input.s2, end_n, utf8, true, NULL);
+
+    *window = (string_subproblem_t) {
+        .x = 0,
+        .m = input.m,
+        .y = end_n - start_len,
+        .n = start_len
+    };
+    return true;
+}
+
+// Fitting alignment: runs Hirschberg with the global values_function only inside the window of s2
+// where s1 fits best
+HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new_fitting)(string_pair_input_t input,
+                                                           hirschberg_options_t options,
+                                                           HIRSCHBERG_TYPED(values_t) *values,
+                                                           HIRSCHBERG_TYPED(function_t) *values_function,
+                                                           HIRSCHBERG_TYPED(function_t) *fitting_function) {
+    string_subproblem_t window;
+    if (!HIRSCHBERG_TYPED(fitting_window)(input, options, values, fitting_function, &window, NULL)) {
+        window = (string_subproblem_t) {
+            .x = 0,
+            .m = input.m,
+            .y = 0,
+            .n = input.n
+        };
+    }
+    return HIRSCHBERG_TYPED(iter_new_window)(input, options, values, values_function, window);
+}
+
+#ifdef HIRSCHBERG_SIMILARITY
+// Score-only local (Smith-Waterman) pass over (s1, m) and (s2, n), reversed when reverse is set.
+// Returns the best local score and writes the end of the best cell to end_m and end_n as byte counts
+// consumed from the start of the (possibly reversed) strings. On ties the kernel must report the first
+// cell to reach the maximum in its scan order (only move the end on a strictly better score). Then no
+// other alignment with the best score fits before the end cell, so the reverse pass can only peak on
+// alignments ending there. With the last maximum, e.g. "AB" vs "ABzzAB", the reverse pass can peak on
+// the other "AB" and the window would span both.
+typedef VALUE_TYPE (*HIRSCHBERG_TYPED(function_local))(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, size_t *end_m, size_t *end_n, void *options);
+
+// Finds the rectangle of the best local alignment with a forward pass for its end and a reverse
+// pass from that end for its start, both in linear space. Returns false if nothing scores above zero.
+static bool HIRSCHBERG_TYPED(local_window)(string_pair_input_t input, HIRSCHBERG_TYPED(values_t) *values,
+                                           HIRSCHBERG_TYPED(function_local) local_function, void *local_options,
+                                           string_subproblem_t *window, VALUE_TYPE *score) {
+    if (values == NULL || local_function == NULL || window == NULL) return false;
+    *window = NULL_SUBPROBLEM;
+    if (input.m == 0 || input.n == 0) return false;
+
+    VALUE_TYPE *forward_values = HIRSCHBERG_TYPED(forward_values)(values);
+    size_t values_len = values->size;
+
+    size_t end_m = 0;
+    size_t end_n = 0;
+    VALUE_TYPE best = local_function(input.s1, input.m, input.s2, input.n, false, forward_values, values_len, &end_m, &end_n, local_options);
+    if (score != NULL) *score = best;
+    if (!(best > (VALUE_TYPE) 0) || end_m > input.m || end_n > input.n) return false;
+
+    // the alignment ending at (end_m, end_n) starts where the reverse pass over the prefixes peaks
+    size_t start_m = 0;
+    size_t start_n = 0;
+    local_function(input.s1, end_m, input.s2, end_n, true, forward_values, values_len, &start_m, &start_n, local_options);
+    if (start_m > end_m || start_n > end_n) return false;
+
+    *window = (string_subproblem_t) {
+        .x = end_m - start_m,
+        .m = start_m,
+        .y = end_n - start_n,
+        .n = start_n
+    };
+    return true;
+}
+
+// Local alignment: runs Hirschberg with values_function only inside the best local window.
+// values_function should be the global counterpart of local_function (same scores, no zero floor).
+HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new_local)(string_pair_input_t input,
+                                                         hirschberg_options_t options,
+                                                         HIRSCHBERG_TYPED(values_t) *values,
+                                                         HIRSCHBERG_TYPED(function_t) *values_function,
+                                                         HIRSCHBERG_TYPED(function_local) local_function,
+                                                         void *local_options) {
+    string_subproblem_t window;
+    VALUE_TYPE score;
+    if (!HIRSCHBERG_TYPED(local_window)(input, values, local_function, local_options, &window, &score)) {
+        window = NULL_SUBPROBLEM;
+    }
+    return HIRSCHBERG_TYPED(iter_new_window)(input, options, values, values_function, window);
+}
+#endif
+
+// Iterates over prepared strings with a prepared kernel. Subproblem coordinates are codepoint indices
+// into the prepared strings, and the utf8 option is ignored since every codepoint is one element.
+HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_new_prepared)(const hirschberg_prepared_string_t *s1,
+                                                            const hirschberg_prepared_string_t *s2,
+                                                            hirschberg_options_t options,
+                                                            HIRSCHBERG_TYPED(values_t) *values,
+                                                            HIRSCHBERG_TYPED(function_t) *values_function) {
+    if (s1 == NULL || s2 == NULL || values_function == NULL || values_function->type != VALUE_FUNCTION_PREPARED) return NULL;
+    options.utf8 = false;
+    HIRSCHBERG_TYPED(iter) *iter = HIRSCHBERG_TYPED(iter_new)((string_pair_input_t){
+        .s1 = NULL,
+        .m = s1->len,
+        .s2 = NULL,
+        .n = s2->len
+    }, options, values, values_function);
+    if (iter == NULL) return NULL;
+    iter->prepared_s1 = s1;
+    iter->prepared_s2 = s2;
     return iter;
 }
 
 
+// Runs the forward and reverse passes for a subproblem split at sub_m and writes the column split in s2
+// to sub_n. Returns false if a pass fails (the kernel returns 0, e.g. on a character outside a
+// Four-Russians alphabet or values too small). For a prepared kernel, s1 and s2 point at codepoints
+// and sub_m counts them.
+static inline bool HIRSCHBERG_TYPED(split_n)(HIRSCHBERG_TYPED(function_t) *values_function,
+                                             const char *s1, size_t m, const char *s2, size_t n, size_t sub_m, bool utf8,
+                                             VALUE_TYPE *forward_values, size_t values_len,
+                                             VALUE_TYPE *reverse_values, size_t reverse_len,
+                                             VALUE_TYPE *opt_value, size_t *sub_n) {
+    // reverse flag is false on the forward pass and true on the reverse pass
+    static const bool FORWARD = false;
+    static const bool REVERSE = true;
+    size_t size_used = 0;
+    size_t reverse_used = 0;
+    const char *s1_rest = s1 + (values_function->type == VALUE_FUNCTION_PREPARED ? sub_m * sizeof(int32_t) : sub_m);
+
+    if (values_function->split != NULL) {
+        // fused: the reverse pass consumes the forward row directly and selects the split itself,
+        // so it can't run alongside the forward pass
+        size_used = HIRSCHBERG_TYPED(function_call)(values_function, s1, sub_m, s2, n, FORWARD, forward_values, values_len);
+        if (size_used == 0) return false;
+        *sub_n = values_function->split(s1_rest, m - sub_m, s2, n, forward_values, size_used,
+                                        reverse_values, reverse_len, opt_value, values_function->options);
+        return true;
+    }
+
+    #pragma omp parallel sections num_threads(2) if (sub_m * n > OMP_PARALLEL_MIN_SIZE)
+    {
+        #pragma omp section
+        {
+            size_used = HIRSCHBERG_TYPED(function_call)(values_function, s1, sub_m, s2, n, FORWARD, forward_values, values_len);
+        }
+        #pragma omp section
+        {
+            reverse_used = HIRSCHBERG_TYPED(function_call)(values_function, s1_rest, m - sub_m,
+                                                           s2, n, REVERSE, reverse_values, reverse_len);
+        }
+    }
+    if (size_used == 0 || reverse_used == 0) return false;
+    *sub_n = HIRSCHBERG_TYPED(split_select)(forward_values, reverse_values, size_used, s2, utf8, opt_value);
+    return true;
+}
+
+// Marks the iterator as failed after a kernel error: iteration stops and there is no score
+static inline bool HIRSCHBERG_TYPED(iter_fail)(HIRSCHBERG_TYPED(iter) *iter) {
+    iter->failed = true;
+    iter->has_score = false;
+    string_subproblem_array_clear(iter->stack);
+    return false;
+}
+
+static bool HIRSCHBERG_TYPED(iter_next_prepared)(HIRSCHBERG_TYPED(iter) *iter) {
+    const int32_t *s1 = iter->prepared_s1->codepoints;
+    const int32_t *s2 = iter->prepared_s2->codepoints;
+    string_subproblem_array *stack = iter->stack;
+
+    if (!string_subproblem_array_pop(stack, &iter->sub)) return false;
+    string_subproblem_t sub = iter->sub;
+
+    bool single_char_n = false;
+    bool single_char_m = false;
+
+    if (prepared_subproblem_is_result(s1, s2, sub, &single_char_m, &single_char_n)) {
+        iter->is_result = true;
+        return true;
+    }
+
+    iter->is_result = false;
+
+    size_t sub_m = prepared_subproblem_split_m(s1, s2, iter->options, sub);
+
+    if (iter->options.init_values_zero) {
+        HIRSCHBERG_TYPED(zero_values)(iter->values);
+    }
+
+    VALUE_TYPE *forward_values = HIRSCHBERG_TYPED(forward_values)(iter->values);
+    VALUE_TYPE *reverse_values = HIRSCHBERG_TYPED(reverse_values)(iter->values);
+    size_t values_len = iter->values->size;
+
+    VALUE_TYPE opt_sum = WORST_VALUE;
+    size_t sub_n = 0;
+    if (!HIRSCHBERG_TYPED(split_n)(iter->values_function, (const char *)(s1 + sub.x), sub.m, (const char *)(s2 + sub.y), sub.n,
+                                   sub_m, false, forward_values, values_len, reverse_values, iter->values->scratch_size, &opt_sum, &sub_n)) {
+        return HIRSCHBERG_TYPED(iter_fail)(iter);
+    }
+    if (subproblem_equals(sub, iter->root)) {
+        iter->score = opt_sum;
+        iter->has_score = true;
+    }
+
+    string_subproblem_t left_sub, right_sub;
+    subproblem_split(iter->input, false, sub, sub_m, sub_n, single_char_m, single_char_n, &left_sub, &right_sub);
+    string_subproblem_array_push(stack, right_sub);
+    string_subproblem_array_push(stack, left_sub);
+    return true;
+}
+
 static bool HIRSCHBERG_TYPED(iter_next)(HIRSCHBERG_TYPED(iter) *iter) {
     if (iter == NULL || iter->stack == NULL || iter->values == NULL || iter->values_function == NULL) return false;
     string_pair_input_t input = iter->input;
     if (input.m == 0 || input.n == 0) return false;
+    if (iter->prepared_s1 != NULL && iter->prepared_s2 != NULL) return HIRSCHBERG_TYPED(iter_next_prepared)(iter);
 
     hirschberg_options_t options = iter->options;
     bool utf8 = options.utf8;
-    bool allow_transpose = options.allow_transpose;
     string_subproblem_array *stack = iter->stack;
 
-    if (!string_subproblem_array_pop(stack, &iter->sub)) return false;
-    string_subproblem_t sub = iter->sub;
+    if (!string_subproblem_array_pop(stack, &iter->sub)) return false;
+    string_subproblem_t sub = iter->sub;
+
+    bool single_char_n = false;
+    bool single_char_m = false;
+
+    if (subproblem_is_result(input, utf8, sub, &single_char_m, &single_char_n)) {
+        iter->is_result = true;
+        return true;
+    }
+
+    iter->is_result = false;
+
+    HIRSCHBERG_TYPED(function_t) *values_function = iter->values_function;
+    if (values_function->type > VALUE_FUNCTION_VARARGS) return false;
+
+    size_t sub_m = subproblem_split_m(input, options, sub);
+
+    if (options.init_values_zero) {
+        HIRSCHBERG_TYPED(zero_values)(iter->values);
+    }
+
+    VALUE_TYPE *forward_values = HIRSCHBERG_TYPED(forward_values)(iter->values);
+    VALUE_TYPE *reverse_values = HIRSCHBERG_TYPED(reverse_values)(iter->values);
+    size_t values_len = iter->values->size;
+
+    VALUE_TYPE opt_sum = WORST_VALUE;
+    size_t sub_n = 0;
+    if (!HIRSCHBERG_TYPED(split_n)(values_function, input.s1 + sub.x, sub.m, input.s2 + sub.y, sub.n, sub_m, utf8,
+                                   forward_values, values_len, reverse_values, iter->values->scratch_size, &opt_sum, &sub_n)) {
+        return HIRSCHBERG_TYPED(iter_fail)(iter);
+    }
+    if (subproblem_equals(sub, iter->root)) {
+        iter->score = opt_sum;
+        iter->has_score = true;
+    }
+
+    string_subproblem_t left_sub, right_sub;
+    subproblem_split(input, utf8, sub, sub_m, sub_n, single_char_m, single_char_n, &left_sub, &right_sub);
+    string_subproblem_array_push(stack, right_sub);
+    string_subproblem_array_push(stack, left_sub);
+    return true;
+}
+
+// Level-synchronous execution: drains the iterator breadth-first, computing the passes for every
+// subproblem at the same recursion depth in one parallel batch over a contiguous values buffer.
+// Each pass gets a slice of values_per_column * (n + 1) values for its subproblem's n.
+// The kernel API computes one row per call, so a level is still two kernel calls per subproblem,
+// spread over threads with a parallel for rather than fused into one batched call. The gain is
+// parallelism across the many small subproblems of deep levels, which are under
+// OMP_PARALLEL_MIN_SIZE and run serially in iter_next; on a single core it matches iter_next.
+// Expansion stops after max_depth levels, and the subproblems of the last level (leaves or not)
+// are written to results in alignment order.
+static bool HIRSCHBERG_TYPED(iter_expand_levels)(HIRSCHBERG_TYPED(iter) *iter, size_t values_per_column, size_t max_depth, string_subproblem_array *results) {
+    if (iter == NULL || iter->stack == NULL || iter->values_function == NULL || results == NULL) return false;
+    if (values_per_column == 0) return false;
+    string_pair_input_t input = iter->input;
+    if (input.m == 0 || input.n == 0) return false;
+
+    hirschberg_options_t options = iter->options;
+    bool utf8 = options.utf8;
+    HIRSCHBERG_TYPED(function_t) *values_function = iter->values_function;
+    if (values_function->type > VALUE_FUNCTION_VARARGS) return false;
+
+    string_subproblem_array *level = string_subproblem_array_new();
+    string_subproblem_array *next_level = string_subproblem_array_new();
+    if (level == NULL || next_level == NULL) {
+        if (level != NULL) string_subproblem_array_destroy(level);
+        if (next_level != NULL) string_subproblem_array_destroy(next_level);
+        return false;
+    }
+
+    typedef struct {
+        size_t sub_m;
+        size_t sub_n;
+        size_t offset;
+        bool is_result;
+        bool failed;
+        bool single_char_m;
+        bool single_char_n;
+    } level_entry_t;
+
+    level_entry_t *entries = NULL;
+    size_t entries_size = 0;
+    VALUE_TYPE *values = NULL;
+    size_t values_size = 0;
+    bool success = true;
+
+    // the top of the stack is processed first, so the level is the stack in reverse
+    string_subproblem_t sub;
+    while (string_subproblem_array_pop(iter->stack, &sub)) {
+        string_subproblem_array_push(level, sub);
+    }
+
+    bool pending = true;
+    for (size_t depth = 0; pending && depth < max_depth; depth++) {
+        size_t num_subs = level->n;
+        if (num_subs > entries_size) {
+            level_entry_t *new_entries = realloc(entries, sizeof(level_entry_t) * num_subs);
+            if (new_entries == NULL) {
+                success = false;
+                break;
+            }
+            entries = new_entries;
+            entries_size = num_subs;
+        }
+
+        // classify serially and lay out each pending subproblem's passes contiguously
+        pending = false;
+        size_t total_values = 0;
+        for (size_t i = 0; i < num_subs; i++) {
+            level_entry_t *entry = &entries[i];
+            sub = level->a[i];
+            entry->is_result = subproblem_is_result(input, utf8, sub, &entry->single_char_m, &entry->single_char_n);
+            if (entry->is_result) continue;
+            pending = true;
+            entry->sub_m = subproblem_split_m(input, options, sub);
+            entry->offset = total_values;
+            total_values += 2 * values_per_column * (sub.n + 1);
+        }
+        if (!pending) break;
+
+        if (total_values > values_size) {
+            VALUE_TYPE *new_values = realloc(values, sizeof(VALUE_TYPE) * total_values);
+            if (new_values == NULL) {
+                success = false;
+                break;
+            }
+            values = new_values;
+            values_size = total_values;
+        }
+        if (options.init_values_zero) {
+            memset(values, 0, sizeof(VALUE_TYPE) * total_values);
+        }
+
+        #pragma omp parallel for schedule(dynamic) if (total_values > OMP_PARALLEL_MIN_SIZE)
+        for (size_t i = 0; i < num_subs; i++) {
+            level_entry_t *entry = &entries[i];
+            if (entry->is_result) continue;
+            string_subproblem_t level_sub = level->a[i];
+            size_t values_len = values_per_column * (level_sub.n + 1);
+            VALUE_TYPE *forward_values = values + entry->offset;
+            VALUE_TYPE *reverse_values = forward_values + values_len;
+            VALUE_TYPE opt_sum = WORST_VALUE;
+            if (!HIRSCHBERG_TYPED(split_n)(values_function, input.s1 + level_sub.x, level_sub.m,
+                                           input.s2 + level_sub.y, level_sub.n, entry->sub_m, utf8,
+                                           forward_values, values_len, reverse_values, values_len, &opt_sum, &entry->sub_n)) {
+                entry->failed = true;
+                continue;
+            }
+            entry->failed = false;
+            if (subproblem_equals(level_sub, iter->root)) {
+                iter->score = opt_sum;
+                iter->has_score = true;
+            }
+        }
+
+        for (size_t i = 0; i < num_subs; i++) {
+            if (!entries[i].is_result && entries[i].failed) success = false;
+        }
+        if (!success) {
+            HIRSCHBERG_TYPED(iter_fail)(iter);
+            break;
+        }
+
+        // expand in order so the next level stays in alignment order
+        string_subproblem_array_clear(next_level);
+        for (size_t i = 0; i < num_subs; i++) {
+            level_entry_t *entry = &entries[i];
+            sub = level->a[i];
+            if (entry->is_result) {
+                string_subproblem_array_push(next_level, sub);
+                continue;
+            }
+            string_subproblem_t left_sub, right_sub;
+            subproblem_split(input, utf8, sub, entry->sub_m, entry->sub_n, entry->single_char_m, entry->single_char_n, &left_sub, &right_sub);
+            string_subproblem_array_push(next_level, left_sub);
+            string_subproblem_array_push(next_level, right_sub);
+        }
+
+        string_subproblem_array *tmp = level;
+        level = next_level;
+        next_level = tmp;
+    }
+
+    if (success) {
+        for (size_t i = 0; i < level->n; i++) {
+            string_subproblem_array_push(results, level->a[i]);
+        }
+    }
+
+    free(entries);
+    free(values);
+    string_subproblem_array_destroy(level);
+    string_subproblem_array_destroy(next_level);
+    return success;
+}
+
+// Runs the whole alignment level by level, results receives the leaf subproblems in alignment order
+static inline bool HIRSCHBERG_TYPED(iter_run_levels)(HIRSCHBERG_TYPED(iter) *iter, size_t values_per_column, string_subproblem_array *results) {
+    return HIRSCHBERG_TYPED(iter_expand_levels)(iter, values_per_column, SIZE_MAX, results);
+}
+
+// Built-in unit-cost kernel over prepared strings: LCS for similarity, Levenshtein for distance.
+// Uses two rows, so values_size must be at least 2 * (n + 1).
+static size_t HIRSCHBERG_TYPED(prepared_unit_cost)(const int32_t *s1, size_t m, const int32_t *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size) {
+    if (values_size < 2 * (n + 1)) return 0;
+    VALUE_TYPE *cur = values;
+    VALUE_TYPE *prev = values + n + 1;
+
+    for (size_t j = 0; j <= n; j++) {
+        #ifdef HIRSCHBERG_SIMILARITY
+        cur[j] = (VALUE_TYPE) 0;
+        #else
+        cur[j] = (VALUE_TYPE) j;
+        #endif
+    }
+
+    for (size_t i = 1; i <= m; i++) {
+        VALUE_TYPE *tmp = prev;
+        prev = cur;
+        cur = tmp;
+        int32_t c1 = !reverse ? s1[i - 1] : s1[m - i];
+        #ifdef HIRSCHBERG_SIMILARITY
+        cur[0] = (VALUE_TYPE) 0;
+        #else
+        cur[0] = (VALUE_TYPE) i;
+        #endif
+        for (size_t j = 1; j <= n; j++) {
+            int32_t c2 = !reverse ? s2[j - 1] : s2[n - j];
+            #ifdef HIRSCHBERG_SIMILARITY
+            VALUE_TYPE best = prev[j] > cur[j - 1] ? prev[j] : cur[j - 1];
+            cur[j] = c1 == c2 ? prev[j - 1] + 1 : best;
+            #else
+            VALUE_TYPE best = (prev[j] < cur[j - 1] ? prev[j] : cur[j - 1]) + 1;
+            VALUE_TYPE sub = prev[j - 1] + (c1 != c2);
+            cur[j] = sub < best ? sub : best;
+            #endif
+        }
+    }
+
+    // the final row is always returned at the start of values
+    if (cur != values) {
+        memcpy(values, cur, sizeof(VALUE_TYPE) * (n + 1));
+    }
+    return n + 1;
+}
+
+// Unit-cost kernel over t x t blocks using precomputed Four-Russians tables, passed as the options of
+// function_new_options. The row is advanced t rows at a time by table lookups on offset-encoded block
+// boundaries, and columns or rows left over at the edges are finished with the plain recurrence.
+// Needs values_size of at least 2 * (n + 1). Returns 0 if a character is outside the table's alphabet
+// (see hirschberg_four_russians_accepts) or the table's model doesn't match the instantiation.
+// Lookups replace t * t cells each, but per block they cost about as much as a few plain cells: on
+// DNA with one core, t = 2 runs about even with the plain row kernel (1.51s vs 1.40s for m = 300,
+// n = 2M) and t = 3 is faster (0.83s), so use the largest t whose table fits.
+static size_t HIRSCHBERG_TYPED(four_russians_values)(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, void *options) {
+    const hirschberg_four_russians_t *tables = options;
+    if (tables == NULL || values_size < 2 * (n + 1)) return 0;
+    #ifdef HIRSCHBERG_SIMILARITY
+    if (tables->model != HIRSCHBERG_FOUR_RUSSIANS_LCS) return 0;
+    #define FOUR_RUSSIANS_BASE(k) ((VALUE_TYPE) 0)
+    #else
+    if (tables->model != HIRSCHBERG_FOUR_RUSSIANS_LEVENSHTEIN) return 0;
+    #define FOUR_RUSSIANS_BASE(k) ((VALUE_TYPE) (k))
+    #endif
+    #define FOUR_RUSSIANS_S1(i) (tables->alphabet_map[(unsigned char)(!reverse ? s1[(i) - 1] : s1[m - (i)])])
+    #define FOUR_RUSSIANS_S2(j) (tables->alphabet_map[(unsigned char)(!reverse ? s2[(j) - 1] : s2[n - (j)])])
+
+    if (!hirschberg_four_russians_accepts(tables, s1, m) || !hirschberg_four_russians_accepts(tables, s2, n)) return 0;
+
+    size_t t = tables->t;
+    size_t sigma = tables->sigma;
+    size_t pow3_t = tables->pow3_t;
+    size_t n_blocks = n / t;
+    size_t n_full = n_blocks * t;
+    size_t m_full = (m / t) * t;
+    hirschberg_four_russians_model_t model = tables->model;
+
+    VALUE_TYPE *row = values;
+    // encoded horizontal offsets (offset + 1) of the current row, column j at offsets[j - 1]
+    VALUE_TYPE *offsets = values + n + 1;
+
+    for (size_t j = 0; j <= n; j++) {
+        row[j] = FOUR_RUSSIANS_BASE(j);
+    }
+
+    // first column offsets are +1 for Levenshtein and 0 for LCS
+    size_t base_left_code = 0;
+    for (size_t k = 0; k < t; k++) {
+        base_left_code = base_left_code * 3 + (model == HIRSCHBERG_FOUR_RUSSIANS_LEVENSHTEIN ? 2 : 1);
+    }
+
+    // the blocked columns stay offset-encoded across block rows, only the value at n_full is carried
+    // as corner for the leftover columns, and row[0..n_full] is rebuilt from the offsets once at the end
+    for (size_t j = 1; j <= n_full; j++) {
+        offsets[j - 1] = row[j] > row[j - 1] ? 2 : (row[j] == row[j - 1] ? 1 : 0);
+    }
+    VALUE_TYPE corner = row[n_full];
+
+    for (size_t i0 = 0; i0 < m_full; i0 += t) {
+        size_t s1_code = 0;
+        for (size_t k = t; k > 0; k--) {
+            s1_code = s1_code * sigma + (size_t)FOUR_RUSSIANS_S1(i0 + k);
+        }
+
+        size_t left_code = base_left_code;
+        for (size_t block = 0; block < n_blocks; block++) {
+            size_t j0 = block * t;
+            size_t s2_code = 0;
+            size_t top_code = 0;
+            for (size_t k = t; k > 0; k--) {
+                s2_code = s2_code * sigma + (size_t)FOUR_RUSSIANS_S2(j0 + k);
+                top_code = top_code * 3 + (size_t)offsets[j0 + k - 1];
+            }
+            size_t idx = ((s1_code * tables->sigma_t + s2_code) * pow3_t + top_code) * pow3_t + left_code;
+            size_t entry = tables->table[idx];
+            size_t bottom_code = entry / pow3_t;
+            left_code = entry % pow3_t;
+            for (size_t k = 0; k < t; k++) {
+                offsets[j0 + k] = (VALUE_TYPE)(bottom_code % 3);
+                bottom_code /= 3;
+            }
+        }
+
+        // left column of the leftover columns, from the right offsets of the last block
+        VALUE_TYPE edge[HIRSCHBERG_FOUR_RUSSIANS_MAX_T + 1];
+        edge[0] = corner;
+        for (size_t k = 1; k <= t; k++) {
+            size_t digit = left_code % 3;
+            left_code /= 3;
+            edge[k] = digit == 0 ? edge[k - 1] - 1 : edge[k - 1] + (VALUE_TYPE)(digit - 1);
+        }
+
+        for (size_t k = 1; k <= t && n_full < n; k++) {
+            int16_t c1 = FOUR_RUSSIANS_S1(i0 + k);
+            VALUE_TYPE diag = edge[k - 1];
+            VALUE_TYPE left = edge[k];
+            for (size_t j = n_full + 1; j <= n; j++) {
+                VALUE_TYPE up = row[j];
+                VALUE_TYPE cur = (VALUE_TYPE) four_russians_cell(model, (int)diag, (int)up, (int)left, c1 == FOUR_RUSSIANS_S2(j));
+                diag = up;
+                row[j] = cur;
+                left = cur;
+            }
+        }
+        corner = edge[t];
+    }
+
+    if (m_full > 0) {
+        row[0] = FOUR_RUSSIANS_BASE(m_full);
+        for (size_t j = 1; j <= n_full; j++) {
+            row[j] = offsets[j - 1] == 0 ? row[j - 1] - 1 : row[j - 1] + (offsets[j - 1] - 1);
+        }
+    }
+
+    for (size_t i = m_full + 1; i <= m; i++) {
+        int16_t c1 = FOUR_RUSSIANS_S1(i);
+        VALUE_TYPE diag = row[0];
+        VALUE_TYPE left = FOUR_RUSSIANS_BASE(i);
+        row[0] = left;
+        for (size_t j = 1; j <= n; j++) {
+            VALUE_TYPE up = row[j];
+            VALUE_TYPE cur = (VALUE_TYPE) four_russians_cell(model, (int)diag, (int)up, (int)left, c1 == FOUR_RUSSIANS_S2(j));
+            diag = up;
+            row[j] = cur;
+            left = cur;
+        }
+    }
+
+    #undef FOUR_RUSSIANS_BASE
+    #undef FOUR_RUSSIANS_S1
+    #undef FOUR_RUSSIANS_S2
+    return n + 1;
+}
+
+// Unit-cost row kernels (LCS for similarity, Levenshtein for distance) that sweep the DP in column
+// strips instead of whole rows. Each strip runs all m rows over its own segment of values, which stays
+// in L2, and hands the column at its right edge to the next strip, so a long row is streamed from
+// memory once per strip rather than once per row of s1. values[j] holds row i - 1 until it's
+// overwritten with row i, so after the last strip values[0..n] is the final row, as with the other
+// kernels. When there's more than one strip, the boundary column takes the m + 1 values after it.
+// Whether the strips pay off depends on the machine: where the hardware prefetcher already streams a
+// whole row fast enough (measured: 6.81s tiled vs 6.96s plain at m = 300, n = 8M, and no difference at
+// m = 4000, n = 200K), there's no gain, so benchmark against the plain kernel before switching.
+static inline size_t HIRSCHBERG_TYPED(tiled_strip_width)(const hirschberg_tiled_options_t *options) {
+    if (options != NULL && options->strip_width > 0) return options->strip_width;
+    size_t strip_width = HIRSCHBERG_L2_CACHE_SIZE / 2 / sizeof(VALUE_TYPE);
+    return strip_width > 0 ? strip_width : 1;
+}
+
+// Space the tiled kernels need for inputs of at most max_m by max_n characters, for each of the
+// forward and reverse halves of values: the row followed by the boundary column
+static inline size_t HIRSCHBERG_TYPED(tiled_values_size)(size_t max_m, size_t max_n) {
+    return (max_n + 1) + (max_m + 1);
+}
+
+#ifdef HIRSCHBERG_SIMILARITY
+#define TILED_BASE(k) ((VALUE_TYPE) 0)
+#define TILED_CELL(diag, up, left, equal) ((equal) ? (diag) + 1 : ((up) > (left) ? (up) : (left)))
+#else
+#define TILED_BASE(k) ((VALUE_TYPE) (k))
+#define TILED_CELL(diag, up, left, equal) (((diag) + !(equal)) < (((up) < (left) ? (up) : (left)) + 1) \
+                                           ? ((diag) + !(equal)) : (((up) < (left) ? (up) : (left)) + 1))
+#endif
+
+// Shared strip sweep, S1(i) and S2(j) are the 1-based characters of the (possibly reversed) inputs
+#define TILED_SWEEP(EQUAL)                                                                          \
+    do {                                                                                            \
+        for (size_t j = 0; j <= n; j++) {                                                           \
+            values[j] = TILED_BASE(j);                                                              \
+        }                                                                                           \
+        for (size_t j0 = 0; j0 < n; j0 += strip_width) {                                            \
+            size_t j1 = j0 + strip_width < n ? j0 + strip_width : n;                                \
+            /* row 0 of the left boundary column */                                                 \
+            VALUE_TYPE diag_boundary = TILED_BASE(j0);                                              \
+            for (size_t i = 1; i <= m; i++) {                                                       \
+                VALUE_TYPE left = column != NULL && j0 > 0 ? column[i] : TILED_BASE(i);             \
+                VALUE_TYPE diag = diag_boundary;                                                    \
+                diag_boundary = left;                                                               \
+                for (size_t j = j0 + 1; j <= j1; j++) {                                             \
+                    VALUE_TYPE up = values[j];                                                      \
+                    VALUE_TYPE cur = TILED_CELL(diag, up, left, EQUAL(S1(i), S2(j)));               \
+                    values[j] = cur;                                                                \
+                    diag = up;                                                                      \
+                    left = cur;                                                                     \
+                }                                                                                   \
+                if (column != NULL) column[i] = left;                                               \
+            }                                                                                       \
+        }                                                                                           \
+        values[0] = TILED_BASE(m);                                                                  \
+    } while (0)
+
+// Byte kernel for function_new_options, options is a hirschberg_tiled_options_t or NULL for the
+// L2-sized default. values_size must be at least tiled_values_size(m, n). Characters are compared with CHAR_EQUAL, so UTF-8 input should go through
+// prepared_tiled_unit_cost instead.
+static size_t HIRSCHBERG_TYPED(tiled_values)(const char *s1, size_t m, const char *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size, void *options) {
+    if (values_size < n + 1) return 0;
+    size_t strip_width = HIRSCHBERG_TYPED(tiled_strip_width)(options);
+    VALUE_TYPE *column = NULL;
+    if (strip_width < n && m > 0) {
+        if (values_size - (n + 1) < m + 1) return 0;
+        column = values + n + 1;
+    }
+    #define S1(i) (!reverse ? s1[(i) - 1] : s1[m - (i)])
+    #define S2(j) (!reverse ? s2[(j) - 1] : s2[n - (j)])
+    TILED_SWEEP(CHAR_EQUAL);
+    #undef S1
+    #undef S2
+    return n + 1;
+}
+
+#define TILED_CODEPOINT_EQUAL(a, b) ((a) == (b))
+
+// Prepared counterpart of tiled_values with the default strip width
+static size_t HIRSCHBERG_TYPED(prepared_tiled_unit_cost)(const int32_t *s1, size_t m, const int32_t *s2, size_t n, bool reverse, VALUE_TYPE *values, size_t values_size) {
+    if (values_size < n + 1) return 0;
+    size_t strip_width = HIRSCHBERG_TYPED(tiled_strip_width)(NULL);
+    VALUE_TYPE *column = NULL;
+    if (strip_width < n && m > 0) {
+        if (values_size - (n + 1) < m + 1) return 0;
+        column = values + n + 1;
+    }
+    #define S1(i) (!reverse ? s1[(i) - 1] : s1[m - (i)])
+    #define S2(j) (!reverse ? s2[(j) - 1] : s2[n - (j)])
+    TILED_SWEEP(TILED_CODEPOINT_EQUAL);
+    #undef S1
+    #undef S2
+    return n + 1;
+}
+
+#undef TILED_CODEPOINT_EQUAL
+#undef TILED_SWEEP
+#undef TILED_CELL
+#undef TILED_BASE
+
+static inline void HIRSCHBERG_TYPED(iter_destroy)(HIRSCHBERG_TYPED(iter) *iter) {
+    if (iter == NULL) return;
+    if (iter->stack != NULL) string_subproblem_array_destroy(iter->stack);
+    if (iter->values != NULL) HIRSCHBERG_TYPED(values_destroy)(iter->values);
+    if (iter->values_function != NULL) free(iter->values_function);
+    free(iter);
+}
+
+#ifdef HIRSCHBERG_LANES
+// Inter-pair batch kernel: runs one independent pair per lane in lockstep. Row value j of lane l lives at
+// values[j * HIRSCHBERG_LANES + l] so each DP step is a single vector operation across lanes.
+// Lanes with active[l] == false are skipped, sizes_used[l] receives the number of row values for each lane.
+typedef void (*HIRSCHBERG_TYPED(function_lanes))(const string_pair_input_t *inputs, const bool *active, bool reverse, VALUE_TYPE *values, size_t values_size, size_t *sizes_used, void *options);
+
+// Largest value a lane can hold. The lanes kernel keeps lengths, column indices and row values in
+// VALUE_TYPE, all of them bounded by m + n, so pairs with m + n above it go to the scalar path.
+#ifdef HIRSCHBERG_SIMILARITY
+#define LANES_MAX_VALUE ((VALUE_TYPE) ~(VALUE_TYPE) 0)
+#else
+#define LANES_MAX_VALUE ((VALUE_TYPE) MAX_VALUE)
+#endif
 
-    const char *s1 = input.s1 + sub.x;
-    const char *s2 = input.s2 + sub.y;
-    size_t m = sub.m;
-    size_t n = sub.n;
+// Space lanes_unit_cost needs for lanes of at most max_n columns: two interleaved rows, followed by
+// the transposed s2 bytes of all lanes
+static inline size_t HIRSCHBERG_TYPED(lanes_unit_cost_size)(size_t max_n) {
+    return 2 * (max_n + 1) * HIRSCHBERG_LANES + (max_n * HIRSCHBERG_LANES + sizeof(VALUE_TYPE) - 1) / sizeof(VALUE_TYPE);
+}
 
-    bool single_char_n = false;
-    bool single_char_m = false;
+// Built-in unit-cost lanes kernel over bytes: LCS for similarity, Levenshtein for distance.
+// values_size must be at least lanes_unit_cost_size(max n). The two rows alternate by pointer swap,
+// starting from whichever makes the last one land at the front of values. Before the pass, the
+// (case-folded) s2 bytes of all lanes are transposed into the same [j][lane] layout as the rows, in
+// the tail of values, so the character comparisons vectorize along with the recurrence. Fails (all
+// sizes_used 0) if an active lane has m + n above LANES_MAX_VALUE.
+static void HIRSCHBERG_TYPED(lanes_unit_cost)(const string_pair_input_t *inputs, const bool *active, bool reverse, VALUE_TYPE *values, size_t values_size, size_t *sizes_used, void *options) {
+    (void)options;
+    size_t max_m = 0;
+    size_t max_n = 0;
+    for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+        sizes_used[l] = 0;
+        if (!active[l]) continue;
+        if (inputs[l].m > (size_t) LANES_MAX_VALUE || inputs[l].n > (size_t) LANES_MAX_VALUE - inputs[l].m) return;
+        if (inputs[l].m > max_m) max_m = inputs[l].m;
+        if (inputs[l].n > max_n) max_n = inputs[l].n;
+    }
+    size_t row_size = (max_n + 1) * HIRSCHBERG_LANES;
+    if (values_size < HIRSCHBERG_TYPED(lanes_unit_cost_size)(max_n)) return;
 
-    if (m > 0 && n > 0) {
-        if (utf8) {
-            int32_t s1_c1 = 0, s1_c2 = 0, s2_c1 = 0, s2_c2 = 0;
-            utf8proc_ssize_t s1_c1_len = utf8proc_iterate((const uint8_t *)s1, -1, &s1_c1);
-            utf8proc_ssize_t s2_c1_len = utf8proc_iterate((const uint8_t *)s2, -1, &s2_c1);
-            if (s1_c1_len == m && s2_c1_len == n) {
-                iter->is_result = true;
-                return true;
-            } else if (s1_c1_len == m) {
-                single_char_m = true;
-            } else if (s2_c1_len == n) {
-                single_char_n = true;
-            }
-            utf8proc_ssize_t s1_c2_len = utf8proc_iterate((const uint8_t *)s1 + s1_c1_len, -1, &s1_c2);
-            utf8proc_ssize_t s2_c2_len = utf8proc_iterate((const uint8_t *)s2 + s2_c1_len, -1, &s2_c2);
-            if (s1_c1_len + s1_c2_len == m && s2_c1_len + s2_c2_len == n
-                && UTF8_CHAR_EQUAL(s1_c1, s2_c2)
-                && UTF8_CHAR_EQUAL(s1_c2, s2_c1)
-                && !(UTF8_CHAR_EQUAL(s1_c1, s1_c2))
-            ) {
-                iter->is_result = true;
-                return true;
-            }
-        } else {
-            if (m == 1 && n == 1) {
-                iter->is_result = true;
-                return true;
-            } else if (m == 1) {
-                single_char_m = true;
-            } else if (n == 1) {
-                single_char_n = true;
-            } else if (m == 2 && n == 2 && CHAR_EQUAL(s1[0], s2[1])
-                        && CHAR_EQUAL(s1[1], s2[0])
-                        && !(CHAR_EQUAL(s1[0], s1[1]))
-            ) {
-                iter->is_result = true;
-                return true;
-            }
+    #ifndef HIRSCHBERG_CASE_SENSITIVE
+    #define LANES_FOLD(c) ((unsigned char)tolower((unsigned char)(c)))
+    #else
+    #define LANES_FOLD(c) ((unsigned char)(c))
+    #endif
+
+    // s2_lanes[(j - 1) * HIRSCHBERG_LANES + l] is character j of lane l, lane_n[l] its length (0 if inactive)
+    unsigned char *s2_lanes = (unsigned char *)(values + 2 * row_size);
+    VALUE_TYPE lane_n[HIRSCHBERG_LANES];
+    for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+        size_t n = active[l] ? inputs[l].n : 0;
+        lane_n[l] = (VALUE_TYPE) n;
+        const char *s2 = inputs[l].s2;
+        for (size_t j = 1; j <= max_n; j++) {
+            s2_lanes[(j - 1) * HIRSCHBERG_LANES + l] = j <= n ? LANES_FOLD(!reverse ? s2[j - 1] : s2[n - j]) : 0;
         }
-    } else if (m == 0 || n == 0) {
-        iter->is_result = true;
-        return true;
     }
 
-    iter->is_result = false;
-
-    size_t sub_m = floor((double)m / 2.0);
-    if (utf8 && utf8_is_continuation(s1[sub_m])) {
-        sub_m -= utf8_prev(s1, sub_m);
+    // after max_m swaps, cur is back where it started, so start at the front when max_m is even
+    VALUE_TYPE *cur = max_m % 2 == 0 ? values : values + row_size;
+    VALUE_TYPE *prev = max_m % 2 == 0 ? values + row_size : values;
+
+    for (size_t j = 0; j <= max_n; j++) {
+        for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+            #ifdef HIRSCHBERG_SIMILARITY
+            cur[j * HIRSCHBERG_LANES + l] = (VALUE_TYPE) 0;
+            #else
+            cur[j * HIRSCHBERG_LANES + l] = (VALUE_TYPE) j;
+            #endif
+        }
     }
-    if (allow_transpose) {
-        if (utf8 && subproblem_border_transpose_utf8(s1, s2, sub, sub_m)) {
-            sub_m += utf8_next(s1 + sub_m);
-        } else if (!utf8 && m > 1 && subproblem_border_transpose(s1, s2, sub, sub_m)) {
-            sub_m++;
+
+    unsigned char c1[HIRSCHBERG_LANES];
+    VALUE_TYPE row_live[HIRSCHBERG_LANES];
+
+    for (size_t i = 1; i <= max_m; i++) {
+        VALUE_TYPE *tmp = prev;
+        prev = cur;
+        cur = tmp;
+        for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+            bool live = active[l] && i <= inputs[l].m;
+            row_live[l] = (VALUE_TYPE) live;
+            c1[l] = live ? LANES_FOLD(!reverse ? inputs[l].s1[i - 1] : inputs[l].s1[inputs[l].m - i]) : 0;
+            // base column: lanes past their last row carry their final row forward
+            #ifdef HIRSCHBERG_SIMILARITY
+            cur[l] = prev[l];
+            #else
+            cur[l] = live ? (VALUE_TYPE) i : prev[l];
+            #endif
+        }
+        for (size_t j = 1; j <= max_n; j++) {
+            const unsigned char *restrict c2 = s2_lanes + (j - 1) * HIRSCHBERG_LANES;
+            VALUE_TYPE *restrict out = cur + j * HIRSCHBERG_LANES;
+            const VALUE_TYPE *restrict left = cur + (j - 1) * HIRSCHBERG_LANES;
+            const VALUE_TYPE *restrict up = prev + j * HIRSCHBERG_LANES;
+            const VALUE_TYPE *restrict diag = prev + (j - 1) * HIRSCHBERG_LANES;
+            #pragma omp simd
+            for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+                VALUE_TYPE live = row_live[l] & (VALUE_TYPE) (j <= lane_n[l]);
+                VALUE_TYPE eq = live & (VALUE_TYPE) (c1[l] == c2[l]);
+                #ifdef HIRSCHBERG_SIMILARITY
+                VALUE_TYPE best = up[l] > left[l] ? up[l] : left[l];
+                VALUE_TYPE match = diag[l] + 1;
+                VALUE_TYPE val = eq ? match : best;
+                #else
+                VALUE_TYPE best = (up[l] < left[l] ? up[l] : left[l]) + 1;
+                VALUE_TYPE sub = diag[l] + (1 - eq);
+                VALUE_TYPE val = sub < best ? sub : best;
+                #endif
+                out[l] = live ? val : up[l];
+            }
         }
     }
 
-    if (options.init_values_zero) {
-        HIRSCHBERG_TYPED(zero_values)(iter->values);
+    #undef LANES_FOLD
+    for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+        if (active[l]) sizes_used[l] = inputs[l].n + 1;
     }
+}
 
-    VALUE_TYPE *forward_values = HIRSCHBERG_TYPED(forward_values)(iter->values);
-    VALUE_TYPE *reverse_values = HIRSCHBERG_TYPED(reverse_values)(iter->values);
-    size_t values_len = iter->values->size;
+// Aligns a batch of pairs HIRSCHBERG_LANES at a time with a lanes kernel. Each lane keeps its own
+// subproblem stack and takes the next pair as soon as its current one is done, so the lanes stay full.
+// results must hold num_pairs arrays, which receive each pair's leaf subproblems in alignment order.
+// With options.utf8, the kernel must return one row value per codepoint of s2; the built-in lanes_unit_cost
+// counts bytes, so it's refused for UTF-8 input. Pairs with m + n above LANES_MAX_VALUE would overflow
+// a lane and are aligned with the scalar iterator over scalar_values and scalar_function instead, which
+// then have to handle them (e.g. LCS values stay within min(m, n)); if those are NULL such pairs are
+// refused up front. Returns false if the kernel fails to fill a lane.
+static bool HIRSCHBERG_TYPED(lanes_align)(const string_pair_input_t *pairs, size_t num_pairs, hirschberg_options_t options,
+                                          HIRSCHBERG_TYPED(function_lanes) lanes_function, void *lanes_options,
+                                          HIRSCHBERG_TYPED(values_t) *scalar_values, HIRSCHBERG_TYPED(function_t) *scalar_function,
+                                          string_subproblem_array **results) {
+    if (pairs == NULL || lanes_function == NULL || results == NULL) return false;
+    bool utf8 = options.utf8;
+    if (utf8 && lanes_function == HIRSCHBERG_TYPED(lanes_unit_cost)) return false;
+    bool has_scalar = scalar_values != NULL && scalar_function != NULL && scalar_function->type <= VALUE_FUNCTION_VARARGS;
+    for (size_t p = 0; p < num_pairs && !has_scalar; p++) {
+        if (pairs[p].m > (size_t) LANES_MAX_VALUE || pairs[p].n > (size_t) LANES_MAX_VALUE - pairs[p].m) return false;
+    }
 
-    HIRSCHBERG_TYPED(function_t) *values_function = iter->values_function;
+    string_subproblem_array *stacks[HIRSCHBERG_LANES];
+    size_t lane_pair[HIRSCHBERG_LANES];
+    string_subproblem_t lane_sub[HIRSCHBERG_LANES];
+    size_t lane_sub_m[HIRSCHBERG_LANES];
+    bool lane_single_char_m[HIRSCHBERG_LANES];
+    bool lane_single_char_n[HIRSCHBERG_LANES];
+    bool active[HIRSCHBERG_LANES];
+    string_pair_input_t forward_inputs[HIRSCHBERG_LANES];
+    string_pair_input_t reverse_inputs[HIRSCHBERG_LANES];
+    size_t sizes_used[HIRSCHBERG_LANES];
+    size_t rev_sizes_used[HIRSCHBERG_LANES];
+
+    bool success = true;
+    for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+        stacks[l] = string_subproblem_array_new();
+        lane_pair[l] = num_pairs;
+        if (stacks[l] == NULL) success = false;
+    }
 
-    // reverse flag is false on the forward pass and true on the reverse pass
-    static const bool FORWARD = false;
-    static const bool REVERSE = true;
-    size_t size_used = 0;
-    size_t rev_size_used = 0;
-    if (values_function->type == VALUE_FUNCTION_STANDARD) {
-        #pragma omp parallel sections num_threads(2) if (sub_m * n > OMP_PARALLEL_MIN_SIZE)
-        {
-            #pragma omp section
-            {
-                size_used = values_function->func.standard(s1, sub_m, s2, n, FORWARD, forward_values, values_len);
+    VALUE_TYPE *values = NULL;
+    size_t values_size = 0;
+    VALUE_TYPE *rows = NULL;
+    size_t rows_size = 0;
+    size_t next_pair = 0;
+
+    while (success) {
+        size_t max_n = 0;
+        bool any_active = false;
+        for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+            active[l] = false;
+            // advance this lane to its next subproblem that needs a split, emitting leaves on the way
+            while (success && !active[l]) {
+                string_subproblem_t sub;
+                if (!string_subproblem_array_pop(stacks[l], &sub)) {
+                    if (next_pair >= num_pairs) break;
+                    lane_pair[l] = next_pair++;
+                    string_pair_input_t pair = pairs[lane_pair[l]];
+                    if (pair.m > (size_t) LANES_MAX_VALUE || pair.n > (size_t) LANES_MAX_VALUE - pair.m) {
+                        HIRSCHBERG_TYPED(iter) *iter = HIRSCHBERG_TYPED(iter_new)(pair, options, scalar_values, scalar_function);
+                        if (iter == NULL) {
+                            success = false;
+                            break;
+                        }
+                        while (HIRSCHBERG_TYPED(iter_next)(iter)) {
+                            if (iter->is_result) string_subproblem_array_push(results[lane_pair[l]], iter->sub);
+                        }
+                        if (iter->failed) success = false;
+                        iter->values = NULL;
+                        iter->values_function = NULL;
+                        HIRSCHBERG_TYPED(iter_destroy)(iter);
+                        continue;
+                    }
+                    if (pair.m > 0 && pair.n > 0) {
+                        string_subproblem_array_push(stacks[l], (string_subproblem_t) {
+                            .x = 0,
+                            .m = pair.m,
+                            .y = 0,
+                            .n = pair.n
+                        });
+                    }
+                    continue;
+                }
+                string_pair_input_t pair = pairs[lane_pair[l]];
+                if (subproblem_is_result(pair, utf8, sub, &lane_single_char_m[l], &lane_single_char_n[l])) {
+                    string_subproblem_array_push(results[lane_pair[l]], sub);
+                    continue;
+                }
+                size_t sub_m = subproblem_split_m(pair, options, sub);
+                lane_sub[l] = sub;
+                lane_sub_m[l] = sub_m;
+                forward_inputs[l] = (string_pair_input_t){
+                    .s1 = pair.s1 + sub.x,
+                    .m = sub_m,
+                    .s2 = pair.s2 + sub.y,
+                    .n = sub.n
+                };
+                reverse_inputs[l] = (string_pair_input_t){
+                    .s1 = pair.s1 + sub.x + sub_m,
+                    .m = sub.m - sub_m,
+                    .s2 = pair.s2 + sub.y,
+                    .n = sub.n
+                };
+                if (sub.n > max_n) max_n = sub.n;
+                active[l] = true;
+                any_active = true;
             }
-            #pragma omp section
-            {
-                rev_size_used = values_function->func.standard(s1 + sub_m, m - sub_m,
-                                                       s2, n, REVERSE, reverse_values, values_len);
+        }
+        if (!success || !any_active) break;
+
+        size_t pass_size = HIRSCHBERG_TYPED(lanes_unit_cost_size)(max_n);
+        if (2 * pass_size > values_size) {
+            VALUE_TYPE *new_values = realloc(values, sizeof(VALUE_TYPE) * 2 * pass_size);
+            if (new_values == NULL) {
+                success = false;
+                break;
             }
+            values = new_values;
+            values_size = 2 * pass_size;
         }
-    } else if (values_function->type == VALUE_FUNCTION_OPTIONS) {
-        #pragma omp parallel sections num_threads(2) if (sub_m * n > OMP_PARALLEL_MIN_SIZE)
+        if (2 * (max_n + 1) > rows_size) {
+            VALUE_TYPE *new_rows = realloc(rows, sizeof(VALUE_TYPE) * 2 * (max_n + 1));
+            if (new_rows == NULL) {
+                success = false;
+                break;
+            }
+            rows = new_rows;
+            rows_size = 2 * (max_n + 1);
+        }
+        if (options.init_values_zero) {
+            memset(values, 0, sizeof(VALUE_TYPE) * 2 * pass_size);
+        }
+
+        VALUE_TYPE *forward_values = values;
+        VALUE_TYPE *reverse_values = values + pass_size;
+        #pragma omp parallel sections num_threads(2) if (max_n * HIRSCHBERG_LANES > OMP_PARALLEL_MIN_SIZE)
         {
             #pragma omp section
             {
-                size_used = values_function->func.options(s1, sub_m, s2, n, FORWARD, forward_values, values_len, values_function->options);
+                lanes_function(forward_inputs, active, false, forward_values, pass_size, sizes_used, lanes_options);
             }
             #pragma omp section
             {
-                rev_size_used = values_function->func.options(s1 + sub_m, m - sub_m,
-                                                       s2, n, REVERSE, reverse_values, values_len, values_function->options);
+                lanes_function(reverse_inputs, active, true, reverse_values, pass_size, rev_sizes_used, lanes_options);
             }
         }
-    } else if (values_function->type == VALUE_FUNCTION_VARARGS) {
-        va_list args;
-        #pragma omp parallel sections num_threads(2) if (sub_m * n > OMP_PARALLEL_MIN_SIZE)
-        {
-            #pragma omp section
-            {
-                va_copy(args, values_function->args);
-                size_used = values_function->func.varargs(s1, sub_m, s2, n, FORWARD, forward_values, values_len, values_function->num_args, args);
-                va_end(args);
+
+        // per-lane split selection on de-interleaved rows
+        VALUE_TYPE *forward_row = rows;
+        VALUE_TYPE *reverse_row = rows + max_n + 1;
+        for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+            if (!active[l]) continue;
+            string_subproblem_t sub = lane_sub[l];
+            string_pair_input_t pair = pairs[lane_pair[l]];
+            size_t size_used = sizes_used[l];
+            if (size_used == 0 || rev_sizes_used[l] == 0) {
+                success = false;
+                break;
             }
-            #pragma omp section
-            {
-                va_copy(args, values_function->args);
-                rev_size_used = values_function->func.varargs(s1 + sub_m, m - sub_m,
-                                                       s2, n, REVERSE, reverse_values, values_len, values_function->num_args, args);
-                va_end(args);
+            if (size_used > max_n + 1) size_used = max_n + 1;
+            for (size_t j = 0; j < size_used; j++) {
+                forward_row[j] = forward_values[j * HIRSCHBERG_LANES + l];
+                reverse_row[j] = reverse_values[j * HIRSCHBERG_LANES + l];
             }
+            VALUE_TYPE opt_sum = WORST_VALUE;
+            size_t sub_n = HIRSCHBERG_TYPED(split_select)(forward_row, reverse_row, size_used, pair.s2 + sub.y, utf8, &opt_sum);
+
+            string_subproblem_t left_sub, right_sub;
+            subproblem_split(pair, utf8, sub, lane_sub_m[l], sub_n, lane_single_char_m[l], lane_single_char_n[l], &left_sub, &right_sub);
+            string_subproblem_array_push(stacks[l], right_sub);
+            string_subproblem_array_push(stacks[l], left_sub);
         }
-    } else {
-        return false;
     }
 
-    size_t sub_n = 0;
+    free(values);
+    free(rows);
+    for (size_t l = 0; l < HIRSCHBERG_LANES; l++) {
+        if (stacks[l] != NULL) string_subproblem_array_destroy(stacks[l]);
+    }
+    return success;
+}
+#endif
 
-    // IMPROVES encodes whether to maximize similarity or minimize distance
-    #ifdef HIRSCHBERG_SIMILARITY
-    #define IMPROVES >
-    VALUE_TYPE opt_sum = (VALUE_TYPE) 0;
+// Incremental re-alignment after an edit. previous holds the leaf subproblems of the alignment before
+// the edit, in order, and input holds the edited strings. Leaves entirely before or after the edit are
+// kept (shifted past it), context extra leaves on either side are re-aligned for slack, and only the
+// window between the remaining anchors is run through the iterator. results receives the new leaves.
+// A window with one side empty (e.g. after deleting all of s1) is emitted as a single gap leaf.
+static bool HIRSCHBERG_TYPED(realign)(string_pair_input_t input, hirschberg_options_t options,
+                                      HIRSCHBERG_TYPED(values_t) *values,
+                                      HIRSCHBERG_TYPED(function_t) *values_function,
+                                      const string_subproblem_array *previous, hirschberg_edit_t edit,
+                                      size_t context, string_subproblem_array *results) {
+    if (previous == NULL || results == NULL || values_function == NULL) return false;
+    // works on byte strings only, prepared inputs have no s1/s2 to re-align
+    if ((input.s1 == NULL && input.m > 0) || (input.s2 == NULL && input.n > 0)) return false;
+    if (values_function->type > VALUE_FUNCTION_VARARGS) return false;
+    size_t num_leaves = previous->n;
+    size_t edit_end = edit.start + edit.old_len;
+
+    // leaves [0, prefix) end at or before the edit, leaves [suffix, num_leaves) start at or after it
+    size_t prefix = 0;
+    while (prefix < num_leaves) {
+        string_subproblem_t leaf = previous->a[prefix];
+        size_t leaf_end = edit.in_s2 ? leaf.y + leaf.n : leaf.x + leaf.m;
+        if (leaf_end > edit.start) break;
+        prefix++;
+    }
+    size_t suffix = num_leaves;
+    while (suffix > prefix) {
+        string_subproblem_t leaf = previous->a[suffix - 1];
+        size_t leaf_start = edit.in_s2 ? leaf.y : leaf.x;
+        if (leaf_start < edit_end) break;
+        suffix--;
+    }
+    prefix = prefix > context ? prefix - context : 0;
+    suffix = num_leaves - suffix > context ? suffix + context : num_leaves;
+
+    // shifts a position on the edited side that lies at or after the end of the edit
+    #define HIRSCHBERG_EDIT_SHIFT(pos) ((pos) - edit.old_len + edit.new_len)
+
+    size_t x0 = 0, y0 = 0;
+    if (prefix > 0) {
+        string_subproblem_t leaf = previous->a[prefix - 1];
+        x0 = leaf.x + leaf.m;
+        y0 = leaf.y + leaf.n;
+    }
+    size_t x1 = input.m, y1 = input.n;
+    if (suffix < num_leaves) {
+        string_subproblem_t leaf = previous->a[suffix];
+        x1 = edit.in_s2 ? leaf.x : HIRSCHBERG_EDIT_SHIFT(leaf.x);
+        y1 = edit.in_s2 ? HIRSCHBERG_EDIT_SHIFT(leaf.y) : leaf.y;
+    }
+    if (x1 < x0 || y1 < y0 || x1 > input.m || y1 > input.n) {
+        // previous alignment doesn't fit the edited input, fall back to a full alignment
+        prefix = 0;
+        suffix = num_leaves;
+        x0 = y0 = 0;
+        x1 = input.m;
+        y1 = input.n;
+    }
+
+    string_subproblem_t window = (string_subproblem_t) {
+        .x = x0,
+        .m = x1 - x0,
+        .y = y0,
+        .n = y1 - y0
+    };
+    HIRSCHBERG_TYPED(iter) *iter = HIRSCHBERG_TYPED(iter_new_window)(input, options, values, values_function, window);
+    if (iter == NULL) return false;
+
+    for (size_t i = 0; i < prefix; i++) {
+        string_subproblem_array_push(results, previous->a[i]);
+    }
+    if (window.m > 0 && window.n > 0) {
+        while (HIRSCHBERG_TYPED(iter_next)(iter)) {
+            if (iter->is_result) {
+                string_subproblem_array_push(results, iter->sub);
+            }
+        }
+    } else if (window.m > 0 || window.n > 0) {
+        // a one-sided window is a single gap leaf, and iter_next yields nothing once a whole side is empty
+        string_subproblem_array_push(results, window);
+    }
+    bool success = !iter->failed;
+    for (size_t i = suffix; i < num_leaves; i++) {
+        string_subproblem_t leaf = previous->a[i];
+        if (edit.in_s2) {
+            leaf.y = HIRSCHBERG_EDIT_SHIFT(leaf.y);
+        } else {
+            leaf.x = HIRSCHBERG_EDIT_SHIFT(leaf.x);
+        }
+        string_subproblem_array_push(results, leaf);
+    }
+    #undef HIRSCHBERG_EDIT_SHIFT
+
+    // values and values_function belong to the caller
+    iter->values = NULL;
+    iter->values_function = NULL;
+    HIRSCHBERG_TYPED(iter_destroy)(iter);
+    return success;
+}
+
+// Checkpoints the iterator: its remaining subproblem stack, options, root and score (if it has one by
+// then). Resume with iter_resume. Prepared iterators can't be checkpointed and return false.
+static bool HIRSCHBERG_TYPED(iter_save)(HIRSCHBERG_TYPED(iter) *iter, FILE *f) {
+    if (iter == NULL || iter->stack == NULL || iter->failed) return false;
+    // prepared iterators have no byte strings to hash for the header
+    if (iter->prepared_s1 != NULL || iter->prepared_s2 != NULL) return false;
+    return hirschberg_subproblems_write(f, iter->input, iter->options, iter->root, iter->has_score ? &iter->score : NULL,
+                                        sizeof(VALUE_TYPE), iter->stack->a, iter->stack->n);
+}
+
+// Restores an iterator saved with iter_save (or a job written by iter_write_jobs) for the same input.
+// The iterator continues exactly where the saved one stopped, with the saved root and score, so it
+// reports the score of the whole alignment even when the root was split before the checkpoint.
+static HIRSCHBERG_TYPED(iter) *HIRSCHBERG_TYPED(iter_resume)(FILE *f, string_pair_input_t input,
+                                                             HIRSCHBERG_TYPED(values_t) *values,
+                                                             HIRSCHBERG_TYPED(function_t) *values_function) {
+    if ((input.s1 == NULL && input.m > 0) || (input.s2 == NULL && input.n > 0)) return NULL;
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = false};
+    string_subproblem_array *subs = string_subproblem_array_new();
+    if (subs == NULL) return NULL;
+    HIRSCHBERG_TYPED(iter) *iter = NULL;
+    string_subproblem_t root;
+    VALUE_TYPE score = WORST_VALUE;
+    bool has_score = false;
+    if (hirschberg_subproblems_read(f, input, &options, &root, &score, sizeof(VALUE_TYPE), &has_score, subs)) {
+        iter = HIRSCHBERG_TYPED(iter_new_window)(input, options, values, values_function, NULL_SUBPROBLEM);
+        if (iter != NULL) {
+            iter->root = root;
+            iter->score = score;
+            iter->has_score = has_score;
+            for (size_t i = 0; i < subs->n; i++) {
+                string_subproblem_array_push(iter->stack, subs->a[i]);
+            }
+        }
+    }
+    string_subproblem_array_destroy(subs);
+    return iter;
+}
+
+// Expands the recursion depth levels deep (at most 2^depth subproblems) and writes each resulting
+// subproblem, in alignment order, to its own job file path_prefix.<i> so separate processes can
+// resume and align them independently. Drains the iterator. Concatenating the jobs' results in
+// order gives the full alignment.
+static bool HIRSCHBERG_TYPED(iter_write_jobs)(HIRSCHBERG_TYPED(iter) *iter, size_t depth, size_t values_per_column,
+                                              const char *path_prefix, size_t *num_jobs) {
+    if (iter == NULL || path_prefix == NULL) return false;
+    if (iter->prepared_s1 != NULL || iter->prepared_s2 != NULL) return false;
+    string_subproblem_array *jobs = string_subproblem_array_new();
+    if (jobs == NULL) return false;
+    bool success = HIRSCHBERG_TYPED(iter_expand_levels)(iter, values_per_column, depth, jobs);
+
+    size_t path_size = strlen(path_prefix) + 32;
+    char *path = success ? malloc(path_size) : NULL;
+    if (path == NULL) success = false;
+
+    for (size_t i = 0; success && i < jobs->n; i++) {
+        snprintf(path, path_size, "%s.%zu", path_prefix, i);
+        FILE *f = fopen(path, "wb");
+        if (f == NULL) {
+            success = false;
+            break;
+        }
+        success = hirschberg_subproblems_write(f, iter->input, iter->options, iter->root, iter->has_score ? &iter->score : NULL,
+                                               sizeof(VALUE_TYPE), &jobs->a[i], 1);
+        if (fclose(f) != 0) success = false;
+    }
+    if (success && num_jobs != NULL) *num_jobs = jobs->n;
+
+    free(path);
+    string_subproblem_array_destroy(jobs);
+    return success;
+}
+
+// Bounded LRU cache of alignment results for repeated (s1, s2) pairs. Entries are keyed by both inputs,
+// the options and the identity of the cost function (kernel, split function and the caller's cache id,
+// see function_set_cache_id), and keep copies of the inputs so a hash collision can never return another pair's alignment.
+// With OpenMP, all operations take the cache's lock, so one cache can be shared between threads.
+// Without OpenMP there is no lock and a cache must only be used from one thread.
+
+// Identity of the kernel a cached result was computed with
+typedef struct {
+    hirschberg_cache_kernel_t kind;
+    union {
+        HIRSCHBERG_TYPED(function_standard) standard;
+        HIRSCHBERG_TYPED(function_options) options;
+        HIRSCHBERG_TYPED(function_prepared) prepared;
+        HIRSCHBERG_TYPED(function_varargs) varargs;
+        #ifdef HIRSCHBERG_LANES
+        HIRSCHBERG_TYPED(function_lanes) lanes;
+        #endif
+    } kernel;
+    HIRSCHBERG_TYPED(function_split) split;
+    uint64_t id;
+    bool has_id;
+} HIRSCHBERG_TYPED(cache_key_t);
+
+typedef struct {
+    uint64_t hash;
+    char *s1;
+    size_t m;
+    char *s2;
+    size_t n;
+    hirschberg_options_t options;
+    HIRSCHBERG_TYPED(cache_key_t) key;
+    VALUE_TYPE score;
+    bool has_score;
+    string_subproblem_array *leaves;
+    size_t prev;
+    size_t next;
+    size_t chain;
+} HIRSCHBERG_TYPED(cache_entry_t);
+
+typedef struct {
+    HIRSCHBERG_TYPED(cache_entry_t) *entries;
+    size_t capacity;
+    size_t size;
+    size_t *buckets;
+    size_t num_buckets;
+    // most and least recently used entries
+    size_t head;
+    size_t tail;
+    hirschberg_cache_stats_t stats;
+    #ifdef _OPENMP
+    omp_lock_t lock;
+    #endif
+} HIRSCHBERG_TYPED(cache_t);
+
+static HIRSCHBERG_TYPED(cache_t) *HIRSCHBERG_TYPED(cache_new)(size_t capacity) {
+    if (capacity == 0) return NULL;
+    HIRSCHBERG_TYPED(cache_t) *cache = malloc(sizeof(HIRSCHBERG_TYPED(cache_t)));
+    if (cache == NULL) return NULL;
+    size_t num_buckets = 1;
+    while (num_buckets < 2 * capacity) num_buckets <<= 1;
+    cache->entries = calloc(capacity, sizeof(HIRSCHBERG_TYPED(cache_entry_t)));
+    cache->buckets = malloc(sizeof(size_t) * num_buckets);
+    if (cache->entries == NULL || cache->buckets == NULL) {
+        free(cache->entries);
+        free(cache->buckets);
+        free(cache);
+        return NULL;
+    }
+    for (size_t i = 0; i < num_buckets; i++) {
+        cache->buckets[i] = HIRSCHBERG_CACHE_NONE;
+    }
+    cache->capacity = capacity;
+    cache->size = 0;
+    cache->num_buckets = num_buckets;
+    cache->head = HIRSCHBERG_CACHE_NONE;
+    cache->tail = HIRSCHBERG_CACHE_NONE;
+    cache->stats = (hirschberg_cache_stats_t){0};
+    #ifdef _OPENMP
+    omp_init_lock(&cache->lock);
+    #endif
+    return cache;
+}
+
+static void HIRSCHBERG_TYPED(cache_destroy)(HIRSCHBERG_TYPED(cache_t) *cache) {
+    if (cache == NULL) return;
+    for (size_t i = 0; i < cache->size; i++) {
+        free(cache->entries[i].s1);
+        free(cache->entries[i].s2);
+        if (cache->entries[i].leaves != NULL) string_subproblem_array_destroy(cache->entries[i].leaves);
+    }
+    #ifdef _OPENMP
+    omp_destroy_lock(&cache->lock);
+    #endif
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache);
+}
+
+static inline void HIRSCHBERG_TYPED(cache_lock)(HIRSCHBERG_TYPED(cache_t) *cache) {
+    #ifdef _OPENMP
+    omp_set_lock(&cache->lock);
     #else
-    #define IMPROVES <
-    VALUE_TYPE opt_sum = (VALUE_TYPE) MAX_VALUE;
+    (void)cache;
     #endif
+}
 
-    #ifndef VALUE_EQUALS
-    #define VALUE_EQUALS_DEFINED
-    #define VALUE_EQUALS(a, b) ((a) == (b))
+static inline void HIRSCHBERG_TYPED(cache_unlock)(HIRSCHBERG_TYPED(cache_t) *cache) {
+    #ifdef _OPENMP
+    omp_unset_lock(&cache->lock);
+    #else
+    (void)cache;
     #endif
+}
 
-    if (utf8) {
-        const char *s2_ptr = s2;
-        size_t s2_consumed = 0;
-        for (size_t j = 0; j < size_used; j++) {
-            size_t c_len = utf8_next(s2_ptr);
-            VALUE_TYPE rev_value = reverse_values[size_used - j - 1];
-            VALUE_TYPE forward_value = forward_values[j];
-            VALUE_TYPE value = forward_value + rev_value;
-            if (value IMPROVES opt_sum || (VALUE_EQUALS(value, opt_sum))) {
-                sub_n = s2_consumed;
-                opt_sum = value;
+// Returns false if the function can't be cached: options or varargs without a cache id
+static inline bool HIRSCHBERG_TYPED(cache_key_function)(HIRSCHBERG_TYPED(function_t) *values_function, HIRSCHBERG_TYPED(cache_key_t) *key_out) {
+    if (!values_function->has_cache_id
+        && (values_function->type == VALUE_FUNCTION_VARARGS || values_function->options != NULL)) {
+        return false;
+    }
+    HIRSCHBERG_TYPED(cache_key_t) key;
+    // zeroed so the unused bytes of the kernel union hash the same every time
+    memset(&key, 0, sizeof(key));
+    switch (values_function->type) {
+        case VALUE_FUNCTION_STANDARD:
+            key.kind = HIRSCHBERG_CACHE_KERNEL_STANDARD;
+            key.kernel.standard = values_function->func.standard;
+            break;
+        case VALUE_FUNCTION_OPTIONS:
+            key.kind = HIRSCHBERG_CACHE_KERNEL_OPTIONS;
+            key.kernel.options = values_function->func.options;
+            break;
+        case VALUE_FUNCTION_PREPARED:
+            key.kind = HIRSCHBERG_CACHE_KERNEL_PREPARED;
+            key.kernel.prepared = values_function->func.prepared;
+            break;
+        default:
+            key.kind = HIRSCHBERG_CACHE_KERNEL_VARARGS;
+            key.kernel.varargs = values_function->func.varargs;
+            break;
+    }
+    key.split = values_function->split;
+    key.id = values_function->cache_id;
+    key.has_id = values_function->has_cache_id;
+    *key_out = key;
+    return true;
+}
+
+#ifdef HIRSCHBERG_LANES
+static inline HIRSCHBERG_TYPED(cache_key_t) HIRSCHBERG_TYPED(cache_key_lanes)(HIRSCHBERG_TYPED(function_lanes) lanes_function, const uint64_t *lanes_id) {
+    HIRSCHBERG_TYPED(cache_key_t) key;
+    memset(&key, 0, sizeof(key));
+    key.kind = HIRSCHBERG_CACHE_KERNEL_LANES;
+    key.kernel.lanes = lanes_function;
+    key.split = NULL;
+    key.id = lanes_id != NULL ? *lanes_id : 0;
+    key.has_id = lanes_id != NULL;
+    return key;
+}
+#endif
+
+static inline bool HIRSCHBERG_TYPED(cache_key_equals)(const HIRSCHBERG_TYPED(cache_key_t) *a, const HIRSCHBERG_TYPED(cache_key_t) *b) {
+    if (a->kind != b->kind || a->split != b->split || a->has_id != b->has_id || a->id != b->id) return false;
+    switch (a->kind) {
+        case HIRSCHBERG_CACHE_KERNEL_STANDARD: return a->kernel.standard == b->kernel.standard;
+        case HIRSCHBERG_CACHE_KERNEL_OPTIONS: return a->kernel.options == b->kernel.options;
+        case HIRSCHBERG_CACHE_KERNEL_PREPARED: return a->kernel.prepared == b->kernel.prepared;
+        #ifdef HIRSCHBERG_LANES
+        case HIRSCHBERG_CACHE_KERNEL_LANES: return a->kernel.lanes == b->kernel.lanes;
+        #endif
+        default: return a->kernel.varargs == b->kernel.varargs;
+    }
+}
+
+static inline uint64_t HIRSCHBERG_TYPED(cache_hash)(string_pair_input_t input, hirschberg_options_t options, const HIRSCHBERG_TYPED(cache_key_t) *key) {
+    uint64_t hash = hirschberg_input_hash(input);
+    unsigned char flags = (options.utf8 ? 1 : 0) | (options.allow_transpose ? 2 : 0) | (options.init_values_zero ? 4 : 0);
+    hash = hirschberg_hash((const char *)&flags, 1, hash);
+    // field by field, skipping struct padding
+    unsigned char kind = (unsigned char)key->kind;
+    hash = hirschberg_hash((const char *)&kind, 1, hash);
+    hash = hirschberg_hash((const char *)&key->kernel, sizeof(key->kernel), hash);
+    hash = hirschberg_hash((const char *)&key->split, sizeof(key->split), hash);
+    unsigned char has_id = key->has_id ? 1 : 0;
+    hash = hirschberg_hash((const char *)&has_id, 1, hash);
+    return hirschberg_hash((const char *)&key->id, sizeof(key->id), hash);
+}
+
+static inline bool HIRSCHBERG_TYPED(cache_entry_matches)(HIRSCHBERG_TYPED(cache_entry_t) *entry, uint64_t hash,
+                                                          string_pair_input_t input, hirschberg_options_t options,
+                                                          const HIRSCHBERG_TYPED(cache_key_t) *key) {
+    return entry->hash == hash && entry->m == input.m && entry->n == input.n
+        && entry->options.utf8 == options.utf8
+        && entry->options.allow_transpose == options.allow_transpose
+        && entry->options.init_values_zero == options.init_values_zero
+        && HIRSCHBERG_TYPED(cache_key_equals)(&entry->key, key)
+        && memcmp(entry->s1, input.s1, input.m) == 0
+        && memcmp(entry->s2, input.s2, input.n) == 0;
+}
+
+static inline size_t HIRSCHBERG_TYPED(cache_find)(HIRSCHBERG_TYPED(cache_t) *cache, uint64_t hash, string_pair_input_t input,
+                                                  hirschberg_options_t options, const HIRSCHBERG_TYPED(cache_key_t) *key) {
+    size_t idx = cache->buckets[hash & (cache->num_buckets - 1)];
+    while (idx != HIRSCHBERG_CACHE_NONE) {
+        if (HIRSCHBERG_TYPED(cache_entry_matches)(&cache->entries[idx], hash, input, options, key)) return idx;
+        idx = cache->entries[idx].chain;
+    }
+    return HIRSCHBERG_CACHE_NONE;
+}
+
+static inline void HIRSCHBERG_TYPED(cache_unlink)(HIRSCHBERG_TYPED(cache_t) *cache, size_t idx) {
+    HIRSCHBERG_TYPED(cache_entry_t) *entry = &cache->entries[idx];
+    if (entry->prev != HIRSCHBERG_CACHE_NONE) {
+        cache->entries[entry->prev].next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next != HIRSCHBERG_CACHE_NONE) {
+        cache->entries[entry->next].prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+}
+
+static inline void HIRSCHBERG_TYPED(cache_push_front)(HIRSCHBERG_TYPED(cache_t) *cache, size_t idx) {
+    HIRSCHBERG_TYPED(cache_entry_t) *entry = &cache->entries[idx];
+    entry->prev = HIRSCHBERG_CACHE_NONE;
+    entry->next = cache->head;
+    if (cache->head != HIRSCHBERG_CACHE_NONE) cache->entries[cache->head].prev = idx;
+    cache->head = idx;
+    if (cache->tail == HIRSCHBERG_CACHE_NONE) cache->tail = idx;
+}
+
+static inline void HIRSCHBERG_TYPED(cache_remove_chain)(HIRSCHBERG_TYPED(cache_t) *cache, size_t idx) {
+    size_t *link = &cache->buckets[cache->entries[idx].hash & (cache->num_buckets - 1)];
+    while (*link != HIRSCHBERG_CACHE_NONE) {
+        if (*link == idx) {
+            *link = cache->entries[idx].chain;
+            return;
+        }
+        link = &cache->entries[*link].chain;
+    }
+}
+
+static inline bool HIRSCHBERG_TYPED(cache_input_valid)(string_pair_input_t input) {
+    // the cache copies and compares the byte strings, which prepared inputs don't have
+    return (input.s1 != NULL || input.m == 0) && (input.s2 != NULL || input.n == 0);
+}
+
+static bool HIRSCHBERG_TYPED(cache_get_key)(HIRSCHBERG_TYPED(cache_t) *cache, string_pair_input_t input, hirschberg_options_t options,
+                                            const HIRSCHBERG_TYPED(cache_key_t) *key, string_subproblem_array *leaves,
+                                            VALUE_TYPE *score, bool *has_score) {
+    if (cache == NULL || !HIRSCHBERG_TYPED(cache_input_valid)(input)) return false;
+    uint64_t hash = HIRSCHBERG_TYPED(cache_hash)(input, options, key);
+    HIRSCHBERG_TYPED(cache_lock)(cache);
+    size_t idx = HIRSCHBERG_TYPED(cache_find)(cache, hash, input, options, key);
+    bool hit = idx != HIRSCHBERG_CACHE_NONE;
+    if (hit) {
+        cache->stats.hits++;
+        HIRSCHBERG_TYPED(cache_unlink)(cache, idx);
+        HIRSCHBERG_TYPED(cache_push_front)(cache, idx);
+        HIRSCHBERG_TYPED(cache_entry_t) *entry = &cache->entries[idx];
+        if (leaves != NULL) {
+            for (size_t i = 0; i < entry->leaves->n; i++) {
+                string_subproblem_array_push(leaves, entry->leaves->a[i]);
             }
-            s2_consumed += c_len;
-            s2_ptr += c_len;
         }
+        if (score != NULL) *score = entry->score;
+        if (has_score != NULL) *has_score = entry->has_score;
     } else {
-        for (size_t j = 0; j < size_used; j++) {
-            VALUE_TYPE forward_value = forward_values[j];
-            VALUE_TYPE rev_value = reverse_values[size_used - j - 1];
-            VALUE_TYPE value = forward_value + rev_value;
-            if (value IMPROVES opt_sum || (VALUE_EQUALS(value, opt_sum))) {
-                sub_n = j;
-                opt_sum = value;
+        cache->stats.misses++;
+    }
+    HIRSCHBERG_TYPED(cache_unlock)(cache);
+    return hit;
+}
+
+// Looks up a cached result. On a hit, appends the cached leaves to leaves (if not NULL), writes the
+// score and returns true. Always misses for functions that can't be cached (see cache_key_function).
+static bool HIRSCHBERG_TYPED(cache_get)(HIRSCHBERG_TYPED(cache_t) *cache, string_pair_input_t input, hirschberg_options_t options,
+                                        HIRSCHBERG_TYPED(function_t) *values_function, string_subproblem_array *leaves,
+                                        VALUE_TYPE *score, bool *has_score) {
+    HIRSCHBERG_TYPED(cache_key_t) key;
+    if (values_function == NULL || !HIRSCHBERG_TYPED(cache_key_function)(values_function, &key)) return false;
+    return HIRSCHBERG_TYPED(cache_get_key)(cache, input, options, &key, leaves, score, has_score);
+}
+
+static bool HIRSCHBERG_TYPED(cache_put_key)(HIRSCHBERG_TYPED(cache_t) *cache, string_pair_input_t input, hirschberg_options_t options,
+                                            const HIRSCHBERG_TYPED(cache_key_t) *key, const string_subproblem_array *leaves,
+                                            VALUE_TYPE score, bool has_score) {
+    if (cache == NULL || leaves == NULL || !HIRSCHBERG_TYPED(cache_input_valid)(input)) return false;
+    uint64_t hash = HIRSCHBERG_TYPED(cache_hash)(input, options, key);
+
+    // copy outside the lock
+    char *s1 = malloc(input.m > 0 ? input.m : 1);
+    char *s2 = malloc(input.n > 0 ? input.n : 1);
+    string_subproblem_array *leaves_copy = string_subproblem_array_new_size(leaves->n > 0 ? leaves->n : 1);
+    if (s1 == NULL || s2 == NULL || leaves_copy == NULL) {
+        free(s1);
+        free(s2);
+        if (leaves_copy != NULL) string_subproblem_array_destroy(leaves_copy);
+        return false;
+    }
+    memcpy(s1, input.s1, input.m);
+    memcpy(s2, input.s2, input.n);
+    for (size_t i = 0; i < leaves->n; i++) {
+        string_subproblem_array_push(leaves_copy, leaves->a[i]);
+    }
+
+    HIRSCHBERG_TYPED(cache_lock)(cache);
+    size_t idx = HIRSCHBERG_TYPED(cache_find)(cache, hash, input, options, key);
+    if (idx != HIRSCHBERG_CACHE_NONE) {
+        // already inserted, e.g. by another thread that missed at the same time
+        HIRSCHBERG_TYPED(cache_unlink)(cache, idx);
+        HIRSCHBERG_TYPED(cache_push_front)(cache, idx);
+        HIRSCHBERG_TYPED(cache_unlock)(cache);
+        free(s1);
+        free(s2);
+        string_subproblem_array_destroy(leaves_copy);
+        return true;
+    }
+
+    char *old_s1 = NULL;
+    char *old_s2 = NULL;
+    string_subproblem_array *old_leaves = NULL;
+    if (cache->size < cache->capacity) {
+        idx = cache->size++;
+    } else {
+        idx = cache->tail;
+        HIRSCHBERG_TYPED(cache_unlink)(cache, idx);
+        HIRSCHBERG_TYPED(cache_remove_chain)(cache, idx);
+        old_s1 = cache->entries[idx].s1;
+        old_s2 = cache->entries[idx].s2;
+        old_leaves = cache->entries[idx].leaves;
+        cache->stats.evictions++;
+    }
+
+    HIRSCHBERG_TYPED(cache_entry_t) *entry = &cache->entries[idx];
+    entry->hash = hash;
+    entry->s1 = s1;
+    entry->m = input.m;
+    entry->s2 = s2;
+    entry->n = input.n;
+    entry->options = options;
+    entry->key = *key;
+    entry->score = score;
+    entry->has_score = has_score;
+    entry->leaves = leaves_copy;
+
+    size_t bucket = hash & (cache->num_buckets - 1);
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = idx;
+    HIRSCHBERG_TYPED(cache_push_front)(cache, idx);
+    cache->stats.insertions++;
+    HIRSCHBERG_TYPED(cache_unlock)(cache);
+
+    free(old_s1);
+    free(old_s2);
+    if (old_leaves != NULL) string_subproblem_array_destroy(old_leaves);
+    return true;
+}
+
+// Stores a result, evicting the least recently used entry when the cache is full. Returns false without
+// storing anything for functions that can't be cached.
+static bool HIRSCHBERG_TYPED(cache_put)(HIRSCHBERG_TYPED(cache_t) *cache, string_pair_input_t input, hirschberg_options_t options,
+                                        HIRSCHBERG_TYPED(function_t) *values_function, const string_subproblem_array *leaves,
+                                        VALUE_TYPE score, bool has_score) {
+    HIRSCHBERG_TYPED(cache_key_t) key;
+    if (values_function == NULL || !HIRSCHBERG_TYPED(cache_key_function)(values_function, &key)) return false;
+    return HIRSCHBERG_TYPED(cache_put_key)(cache, input, options, &key, leaves, score, has_score);
+}
+
+static hirschberg_cache_stats_t HIRSCHBERG_TYPED(cache_stats)(HIRSCHBERG_TYPED(cache_t) *cache) {
+    hirschberg_cache_stats_t stats = (hirschberg_cache_stats_t){0};
+    if (cache == NULL) return stats;
+    HIRSCHBERG_TYPED(cache_lock)(cache);
+    stats = cache->stats;
+    HIRSCHBERG_TYPED(cache_unlock)(cache);
+    return stats;
+}
+
+// Cached alignment: returns the cached leaves for a repeated pair, otherwise aligns it with the iterator
+// (or level by level when values_per_column > 0) and caches the result. values and values_function
+// stay owned by the caller. Prepared inputs aren't supported. Functions that can't be cached (options or
+// varargs without a cache id) are aligned without the cache.
+static bool HIRSCHBERG_TYPED(cache_align)(HIRSCHBERG_TYPED(cache_t) *cache, string_pair_input_t input, hirschberg_options_t options,
+                                          HIRSCHBERG_TYPED(values_t) *values, HIRSCHBERG_TYPED(function_t) *values_function,
+                                          size_t values_per_column, string_subproblem_array *leaves,
+                                          VALUE_TYPE *score, bool *has_score) {
+    if (leaves == NULL || values_function == NULL || !HIRSCHBERG_TYPED(cache_input_valid)(input)) return false;
+    if (values_function->type > VALUE_FUNCTION_VARARGS) return false;
+    if (HIRSCHBERG_TYPED(cache_get)(cache, input, options, values_function, leaves, score, has_score)) return true;
+
+    HIRSCHBERG_TYPED(iter) *iter = HIRSCHBERG_TYPED(iter_new)(input, options, values, values_function);
+    if (iter == NULL) return false;
+    size_t start = leaves->n;
+    bool success = true;
+    if (values_per_column > 0) {
+        success = HIRSCHBERG_TYPED(iter_run_levels)(iter, values_per_column, leaves);
+    } else {
+        while (HIRSCHBERG_TYPED(iter_next)(iter)) {
+            if (iter->is_result) {
+                string_subproblem_array_push(leaves, iter->sub);
             }
         }
+        success = !iter->failed;
+    }
+    if (score != NULL) *score = iter->score;
+    if (has_score != NULL) *has_score = iter->has_score;
+
+    if (success && cache != NULL) {
+        // cache only this call's leaves
+        string_subproblem_array result = (string_subproblem_array){
+            .n = leaves->n - start,
+            .m = leaves->n - start,
+            .a = leaves->a + start
+        };
+        HIRSCHBERG_TYPED(cache_put)(cache, input, options, values_function, &result, iter->score, iter->has_score);
     }
 
-    if ((sub_n == 0 && sub_m == 0) || (sub_n == n && sub_m == m)){
-        if (!utf8) {
-            sub_m = 1;
-            sub_n = 1;
-        } else {
-            sub_m = utf8_next(s1);
-            sub_n = utf8_next(s2);
-        }
-    } else if (sub_m == 0 && sub_n == n && !single_char_m) {
-        if (!utf8) {
-            sub_m = 1;
-        } else {
-            sub_m = utf8_next(s1);
-        }
-    } else if (sub_n == 0 && sub_m == m && !single_char_n) {
-        if (!utf8) {
-            sub_n = 1;
-        } else {
-            sub_n = utf8_next(s2);
+    iter->values = NULL;
+    iter->values_function = NULL;
+    HIRSCHBERG_TYPED(iter_destroy)(iter);
+    return success;
+}
+
+// Batch form of cache_align. results must hold num_pairs arrays; scores and has_scores may be NULL.
+static bool HIRSCHBERG_TYPED(cache_align_batch)(HIRSCHBERG_TYPED(cache_t) *cache, const string_pair_input_t *pairs, size_t num_pairs,
+                                                hirschberg_options_t options, HIRSCHBERG_TYPED(values_t) *values,
+                                                HIRSCHBERG_TYPED(function_t) *values_function, size_t values_per_column,
+                                                string_subproblem_array **results, VALUE_TYPE *scores, bool *has_scores) {
+    if (pairs == NULL || results == NULL) return false;
+    for (size_t i = 0; i < num_pairs; i++) {
+        if (!HIRSCHBERG_TYPED(cache_align)(cache, pairs[i], options, values, values_function, values_per_column, results[i],
+                                           scores != NULL ? &scores[i] : NULL, has_scores != NULL ? &has_scores[i] : NULL)) {
+            return false;
         }
     }
-
-    string_subproblem_t left_sub = (string_subproblem_t) {
-        .x = sub.x,
-        .m = sub_m,
-        .y = sub.y,
-        .n = sub_n
-    };
-    string_subproblem_t right_sub = (string_subproblem_t) {
-        .x = sub.x + sub_m,
-        .m = sub.m - sub_m,
-        .y = sub.y + sub_n,
-        .n = sub.n - sub_n
-    };
-    string_subproblem_array_push(stack, right_sub);
-    string_subproblem_array_push(stack, left_sub);
     return true;
 }
 
-static inline void HIRSCHBERG_TYPED(iter_destroy)(HIRSCHBERG_TYPED(iter) *iter) {
-    if (iter == NULL) return;
-    if (iter->stack != NULL) string_subproblem_array_destroy(iter->stack);
-    if (iter->values != NULL) HIRSCHBERG_TYPED(values_destroy)(iter->values);
-    if (iter->values_function != NULL) free(iter->values_function);
-    free(iter);
+#ifdef HIRSCHBERG_LANES
+// lanes_align with the cache in front of it: hits are filled from the cache and only the misses are
+// packed into lanes. Lanes kernels don't report a score, so entries are stored without one.
+// lanes_id identifies lanes_options and the scalar fallback together, like function_set_cache_id; without
+// it, calls that pass either are aligned without the cache.
+static bool HIRSCHBERG_TYPED(lanes_align_cached)(HIRSCHBERG_TYPED(cache_t) *cache, const string_pair_input_t *pairs, size_t num_pairs,
+                                                 hirschberg_options_t options, HIRSCHBERG_TYPED(function_lanes) lanes_function,
+                                                 void *lanes_options, const uint64_t *lanes_id, HIRSCHBERG_TYPED(values_t) *scalar_values,
+                                                 HIRSCHBERG_TYPED(function_t) *scalar_function, string_subproblem_array **results) {
+    if (pairs == NULL || lanes_function == NULL || results == NULL) return false;
+    if (lanes_id == NULL && (lanes_options != NULL || scalar_function != NULL)) {
+        return HIRSCHBERG_TYPED(lanes_align)(pairs, num_pairs, options, lanes_function, lanes_options,
+                                             scalar_values, scalar_function, results);
+    }
+    HIRSCHBERG_TYPED(cache_key_t) key = HIRSCHBERG_TYPED(cache_key_lanes)(lanes_function, lanes_id);
+
+    string_pair_input_t *misses = malloc(sizeof(string_pair_input_t) * (num_pairs > 0 ? num_pairs : 1));
+    string_subproblem_array **miss_results = malloc(sizeof(string_subproblem_array *) * (num_pairs > 0 ? num_pairs : 1));
+    size_t *miss_index = malloc(sizeof(size_t) * (num_pairs > 0 ? num_pairs : 1));
+    if (misses == NULL || miss_results == NULL || miss_index == NULL) {
+        free(misses);
+        free(miss_results);
+        free(miss_index);
+        return false;
+    }
+    size_t num_misses = 0;
+    for (size_t i = 0; i < num_pairs; i++) {
+        if (HIRSCHBERG_TYPED(cache_get_key)(cache, pairs[i], options, &key, results[i], NULL, NULL)) continue;
+        misses[num_misses] = pairs[i];
+        miss_results[num_misses] = results[i];
+        miss_index[num_misses] = results[i]->n;
+        num_misses++;
+    }
+
+    bool success = num_misses == 0 || HIRSCHBERG_TYPED(lanes_align)(misses, num_misses, options, lanes_function, lanes_options,
+                                                                                   scalar_values, scalar_function, miss_results);
+    for (size_t i = 0; success && i < num_misses; i++) {
+        string_subproblem_array result = (string_subproblem_array){
+            .n = miss_results[i]->n - miss_index[i],
+            .m = miss_results[i]->n - miss_index[i],
+            .a = miss_results[i]->a + miss_index[i]
+        };
+        HIRSCHBERG_TYPED(cache_put_key)(cache, misses[i], options, &key, &result, WORST_VALUE, false);
+    }
+    free(misses);
+    free(miss_results);
+    free(miss_index);
+    return success;
 }
+#endif
 
 
 #undef CONCAT3_
 #undef CONCAT3
 #undef HIRSCHBERG_TYPED
 #undef IMPROVES
+#undef WORST_VALUE
+#ifdef HIRSCHBERG_LANES
+#undef LANES_MAX_VALUE
+#endif
 #ifdef CHAR_EQUAL_DEFINED
 #undef CHAR_EQUAL
 #undef CHAR_EQUAL_DEFINED
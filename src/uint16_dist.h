@@ -0,0 +1,16 @@
+#ifndef HIRSCHBERG_UINT16_DIST_H
+#define HIRSCHBERG_UINT16_DIST_H
+
+#include <stdint.h>
+
+#define VALUE_NAME uint16_dist
+#define VALUE_TYPE uint16_t
+#define HIRSCHBERG_LANES 16
+#define MAX_VALUE UINT16_MAX
+#include "hirschberg.h"
+#undef VALUE_NAME
+#undef VALUE_TYPE
+#undef HIRSCHBERG_LANES
+#undef MAX_VALUE
+
+#endif
\ No newline at end of file
@@ -0,0 +1,16 @@
+#ifndef HIRSCHBERG_UINT16_SIM_H
+#define HIRSCHBERG_UINT16_SIM_H
+
+#include <stdint.h>
+
+#define VALUE_NAME uint16_sim
+#define VALUE_TYPE uint16_t
+#define HIRSCHBERG_LANES 16
+#define HIRSCHBERG_SIMILARITY
+#include "hirschberg.h"
+#undef VALUE_NAME
+#undef VALUE_TYPE
+#undef HIRSCHBERG_LANES
+#undef HIRSCHBERG_SIMILARITY
+
+#endif
\ No newline at end of file
@@ -5,10 +5,12 @@
 
 #define VALUE_NAME uint32_dist
 #define VALUE_TYPE uint32_t
+#define HIRSCHBERG_LANES 8
 #define MAX_VALUE UINT32_MAX
 #include "hirschberg.h"
 #undef VALUE_NAME
 #undef VALUE_TYPE
+#undef HIRSCHBERG_LANES
 #undef MAX_VALUE
 
 #endif
\ No newline at end of file
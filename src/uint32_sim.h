@@ -5,10 +5,12 @@
 
 #define VALUE_NAME uint32_sim
 #define VALUE_TYPE uint32_t
+#define HIRSCHBERG_LANES 8
 #define HIRSCHBERG_SIMILARITY
 #include "hirschberg.h"
 #undef VALUE_NAME
 #undef VALUE_TYPE
+#undef HIRSCHBERG_LANES
 #undef HIRSCHBERG_SIMILARITY
 
 #endif
\ No newline at end of file
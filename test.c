@@ -1,10 +1,18 @@
+// mkdtemp for the job files written by the checkpoint test
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "greatest/greatest.h"
 #include "uint64_sim.h"
+#include "uint32_sim.h"
+#include "uint64_dist.h"
+#include "uint16_dist.h"
+#include "double_sim.h"
 #include "utf8/utf8.h"
 
 typedef struct {
@@ -151,63 +159,255 @@ size_t test_hirschberg_lcs_utf8_cost(const char *s1, size_t m, const char *s2, s
     return used;
 }
 
+size_t test_hirschberg_lcs_options_cost(const char *s1, size_t m, const char *s2, size_t n, bool reverse, uint64_t *costs, size_t costs_size, void *options) {
+    (void)options;
+    return test_hirschberg_lcs_cost(s1, m, s2, n, reverse, costs, costs_size);
+}
+
+
+size_t test_hirschberg_lcs_split(const char *s1, size_t m, const char *s2, size_t n, const uint64_t *forward_costs, size_t forward_size, uint64_t *costs, size_t costs_size, uint64_t *opt_value, void *options) {
+    // a single reverse row, updated in place
+    uint64_t *lcs = costs;
+    size_t num_cols = forward_size;
+    if (costs_size < num_cols) return n;
+    for (size_t k = 0; k < num_cols; k++) {
+        lcs[k] = 0;
+    }
+    size_t s1_consumed = 0;
+    int32_t c1;
+    int32_t c2;
+    while (s1_consumed < m) {
+        ssize_t c1_len = utf8proc_iterate_reversed((const unsigned char *)s1, m - s1_consumed, &c1);
+        if (c1_len <= 0) break;
+        c1 = utf8proc_tolower(c1);
+        size_t s2_consumed = 0;
+        uint64_t diag = 0;
+        for (size_t j = 1; j < num_cols && s2_consumed < n; j++) {
+            ssize_t c2_len = utf8proc_iterate_reversed((const unsigned char *)s2, n - s2_consumed, &c2);
+            if (c2_len <= 0) break;
+            c2 = utf8proc_tolower(c2);
+            uint64_t up = lcs[j];
+            if (c1 == c2) {
+                lcs[j] = diag + 1;
+            } else if (up < lcs[j - 1]) {
+                lcs[j] = lcs[j - 1];
+            }
+            diag = up;
+            s2_consumed += c2_len;
+        }
+        s1_consumed += c1_len;
+    }
+
+    // walk the final reverse row right to left in s2, keeping the rightmost best column
+    size_t sub_n = n;
+    size_t s2_offset = n;
+    uint64_t opt = 0;
+    for (size_t k = 0; k < num_cols; k++) {
+        uint64_t value = forward_costs[num_cols - k - 1] + lcs[k];
+        if (k == 0 || value > opt) {
+            opt = value;
+            sub_n = s2_offset;
+        }
+        s2_offset -= utf8_prev(s2, s2_offset);
+    }
+    *opt_value = opt;
+    return sub_n;
+}
+
+
+// Levenshtein distance, with free leading gaps in s2 when options points to true
+size_t test_hirschberg_levenshtein_cost(const char *s1, size_t m, const char *s2, size_t n, bool reverse, uint64_t *costs, size_t costs_size, void *options) {
+    bool free_s2_gaps = options != NULL && *(bool *)options;
+    uint64_t *cur = costs;
+    uint64_t *prev = costs + n + 1;
+    for (size_t j = 0; j < n + 1; j++) {
+        cur[j] = free_s2_gaps ? 0 : j;
+    }
+    for (size_t i = 1; i < m + 1; i++) {
+        for (size_t j = 0; j < n + 1; j++) {
+            prev[j] = cur[j];
+        }
+        char c1 = !reverse ? tolower(s1[i - 1]) : tolower(s1[m - i]);
+        cur[0] = i;
+        for (size_t j = 1; j < n + 1; j++) {
+            char c2 = !reverse ? tolower(s2[j - 1]) : tolower(s2[n - j]);
+            uint64_t val = prev[j - 1] + (c1 == c2 ? 0 : 1);
+            if (prev[j] + 1 < val) val = prev[j] + 1;
+            if (cur[j - 1] + 1 < val) val = cur[j - 1] + 1;
+            cur[j] = val;
+        }
+    }
+    return n + 1;
+}
+
+
+// Smith-Waterman with match +2, mismatch -1, gap -1, floored at zero
+uint64_t test_hirschberg_local_cost(const char *s1, size_t m, const char *s2, size_t n, bool reverse, uint64_t *costs, size_t costs_size, size_t *end_m, size_t *end_n, void *options) {
+    uint64_t *cur = costs;
+    uint64_t *prev = costs + n + 1;
+    uint64_t best = 0;
+    *end_m = 0;
+    *end_n = 0;
+    for (size_t j = 0; j < n + 1; j++) {
+        cur[j] = 0;
+        prev[j] = 0;
+    }
+    for (size_t i = 1; i < m + 1; i++) {
+        char c1 = !reverse ? tolower(s1[i - 1]) : tolower(s1[m - i]);
+        cur[0] = 0;
+        for (size_t j = 1; j < n + 1; j++) {
+            char c2 = !reverse ? tolower(s2[j - 1]) : tolower(s2[n - j]);
+            int64_t val = (int64_t)prev[j - 1] + (c1 == c2 ? 2 : -1);
+            if ((int64_t)prev[j] - 1 > val) val = (int64_t)prev[j] - 1;
+            if ((int64_t)cur[j - 1] - 1 > val) val = (int64_t)cur[j - 1] - 1;
+            if (val < 0) val = 0;
+            cur[j] = (uint64_t)val;
+            // strictly greater keeps the first maximum, as function_local requires
+            if (cur[j] > best) {
+                best = cur[j];
+                *end_m = i;
+                *end_n = j;
+            }
+        }
+        for (size_t j = 0; j < n + 1; j++) {
+            prev[j] = cur[j];
+        }
+    }
+    return best;
+}
+
+// Signed counterparts of test_hirschberg_local_cost for double_sim: match +2, mismatch -1, gap -1.
+// The global kernel has no zero floor, so split sums can be negative.
+double test_hirschberg_signed_local_cost(const char *s1, size_t m, const char *s2, size_t n, bool reverse, double *costs, size_t costs_size, size_t *end_m, size_t *end_n, void *options) {
+    double *cur = costs;
+    double *prev = costs + n + 1;
+    double best = 0;
+    *end_m = 0;
+    *end_n = 0;
+    for (size_t j = 0; j < n + 1; j++) {
+        cur[j] = 0;
+        prev[j] = 0;
+    }
+    for (size_t i = 1; i < m + 1; i++) {
+        char c1 = !reverse ? s1[i - 1] : s1[m - i];
+        cur[0] = 0;
+        for (size_t j = 1; j < n + 1; j++) {
+            char c2 = !reverse ? s2[j - 1] : s2[n - j];
+            double val = prev[j - 1] + (c1 == c2 ? 2 : -1);
+            if (prev[j] - 1 > val) val = prev[j] - 1;
+            if (cur[j - 1] - 1 > val) val = cur[j - 1] - 1;
+            if (val < 0) val = 0;
+            cur[j] = val;
+            if (cur[j] > best) {
+                best = cur[j];
+                *end_m = i;
+                *end_n = j;
+            }
+        }
+        for (size_t j = 0; j < n + 1; j++) {
+            prev[j] = cur[j];
+        }
+    }
+    return best;
+}
+
+size_t test_hirschberg_signed_global_cost(const char *s1, size_t m, const char *s2, size_t n, bool reverse, double *costs, size_t costs_size) {
+    if (costs_size < 2 * (n + 1)) return 0;
+    double *cur = costs;
+    double *prev = costs + n + 1;
+    for (size_t j = 0; j < n + 1; j++) {
+        cur[j] = -(double)j;
+    }
+    for (size_t i = 1; i < m + 1; i++) {
+        for (size_t j = 0; j < n + 1; j++) {
+            prev[j] = cur[j];
+        }
+        char c1 = !reverse ? s1[i - 1] : s1[m - i];
+        cur[0] = -(double)i;
+        for (size_t j = 1; j < n + 1; j++) {
+            char c2 = !reverse ? s2[j - 1] : s2[n - j];
+            double val = prev[j - 1] + (c1 == c2 ? 2 : -1);
+            if (prev[j] - 1 > val) val = prev[j] - 1;
+            if (cur[j - 1] - 1 > val) val = cur[j - 1] - 1;
+            cur[j] = val;
+        }
+    }
+    return n + 1;
+}
+
+void hirschberg_alignment_lcs_append(const char *s1, const char *s2, string_subproblem_t sub, char *alignment, size_t *idx) {
+    ssize_t c1_len, c2_len;
+    int32_t c1, c2;
+
+    size_t um = utf8_len(s1 + sub.x, sub.m);
+    size_t un = utf8_len(s2 + sub.y, sub.n);
+    if (un == 1) {
+        c2_len = utf8proc_iterate((const unsigned char *) s2 + sub.y, -1, &c2);
+        const unsigned char *s1_ptr = (const unsigned char *) s1 + sub.x;
+        for (size_t j = 0; j < um; j++) {
+            c1_len = utf8proc_iterate(s1_ptr, -1, &c1);
+            if (utf8proc_tolower(c2) == utf8proc_tolower(c1)) {
+                for (size_t k = 0; k < c2_len; k++) {
+                    alignment[(*idx)++] = *(s2 + sub.y + k);
+                }
+                break;
+            }
+        }
+    } else if (um == 2 && un == 2) {
+        alignment[(*idx)++] = '/';
+        alignment[(*idx)++] = '\\';
+    } else if (um == 1) {
+        c2_len = utf8proc_iterate((const unsigned char *) s1 + sub.x, -1, &c2);
+        const unsigned char *s2_ptr = (const unsigned char *) s2 + sub.y;
+        for (size_t j = 0; j < un; j++) {
+            c1_len = utf8proc_iterate(s2_ptr, -1, &c1);
+            if (c2 == c1) {
+                for (size_t k = 0; k < c2_len; k++) {
+                    alignment[(*idx)++] = *(s1 + sub.x + k);
+                }
+                break;
+            }
+        }
+    }
+}
+
 
 char *hirschberg_alignment_lcs(hirschberg_uint64_sim_iter *iter, size_t max_len) {
     char *alignment = malloc(sizeof(char) * (max_len + 1));
     size_t idx = 0;
-    ssize_t c1_len, c2_len;
-    int32_t c1, c2;
-    const unsigned char *s1_ptr;
-    const unsigned char *s2_ptr;
 
     const char *s1 = iter->input.s1;
     const char *s2 = iter->input.s2;
 
-    bool result = true;
-    size_t i = 0;
     while (hirschberg_uint64_sim_iter_next(iter)) {
         if (iter->is_result) {
-            string_subproblem_t sub = iter->sub;
-            size_t um = utf8_len(s1 + sub.x, sub.m);
-            size_t un = utf8_len(s2 + sub.y, sub.n);
-            if (un == 1) {
-                c2_len = utf8proc_iterate((const unsigned char *) s2 + sub.y, -1, &c2);
-                const unsigned char *s1_ptr = (const unsigned char *) s1 + sub.x;
-                for (size_t j = 0; j < um; j++) {
-                    c1_len = utf8proc_iterate(s1_ptr, -1, &c1);
-                    if (utf8proc_tolower(c2) == utf8proc_tolower(c1)) {
-                        for (size_t k = 0; k < c2_len; k++) {
-                            alignment[idx++] = *(s2 + sub.y + k);
-                        }
-                        break;
-                    }
-                }
-            } else if (um == 2 && un == 2) {
-                alignment[idx++] = '/';
-                alignment[idx++] = '\\';
-            } else if (um == 1) {
-                c2_len = utf8proc_iterate((const unsigned char *) s1 + sub.x, -1, &c2);
-                const unsigned char *s2_ptr = (const unsigned char *) s2 + sub.y;
-                for (size_t j = 0; j < un; j++) {
-                    c1_len = utf8proc_iterate(s2_ptr, -1, &c1);
-                    if (c2 == c1) {
-                        for (size_t k = 0; k < c2_len; k++) {
-                            alignment[idx++] = *(s1 + sub.x + k);
-                        }
-                        break;
-                    }
-                }
-            }
-            i++;
+            hirschberg_alignment_lcs_append(s1, s2, iter->sub, alignment, &idx);
+        }
+    }
+
+    alignment[idx] = '\0';
+    return alignment;
+}
+
+
+char *hirschberg_alignment_lcs_levels(hirschberg_uint64_sim_iter *iter, size_t max_len) {
+    char *alignment = malloc(sizeof(char) * (max_len + 1));
+    size_t idx = 0;
+
+    string_subproblem_array *results = string_subproblem_array_new();
+    if (hirschberg_uint64_sim_iter_run_levels(iter, 2, results)) {
+        for (size_t i = 0; i < results->n; i++) {
+            hirschberg_alignment_lcs_append(iter->input.s1, iter->input.s2, results->a[i], alignment, &idx);
         }
     }
+    string_subproblem_array_destroy(results);
 
     alignment[idx] = '\0';
     return alignment;
 }
 
 
-bool test_hirschberg_subproblem_lcs(lcs_test_t test) {
+bool test_hirschberg_subproblem_lcs(lcs_test_t test, bool fused, bool levels) {
     const char *s1 = test.s1;
     const char *s2 = test.s2;
     size_t m = strlen(s1);
@@ -232,14 +432,20 @@ bool test_hirschberg_subproblem_lcs(lcs_test_t test) {
 
     size_t values_size = (un + 1) * 2;
 
+    hirschberg_uint64_sim_function_t *function = hirschberg_uint64_sim_function_new(is_utf8 ? test_hirschberg_lcs_utf8_cost : test_hirschberg_lcs_cost);
+    if (fused) {
+        hirschberg_uint64_sim_function_set_split(function, test_hirschberg_lcs_split);
+    }
+
     hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new(
         (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n},
         (hirschberg_options_t){.utf8 = is_utf8, .allow_transpose = false, .init_values_zero = true},
-        hirschberg_uint64_sim_values_new(values_size),
-        hirschberg_uint64_sim_function_new(is_utf8 ? test_hirschberg_lcs_utf8_cost : test_hirschberg_lcs_cost)
+        // the fused split only needs one reverse row of scratch
+        fused ? hirschberg_uint64_sim_values_new_split(values_size, un + 1) : hirschberg_uint64_sim_values_new(values_size),
+        function
     );
 
-    char *alignment = hirschberg_alignment_lcs(iter, max_len);
+    char *alignment = levels ? hirschberg_alignment_lcs_levels(iter, max_len) : hirschberg_alignment_lcs(iter, max_len);
 
     bool success = strncmp(alignment, test.expected_lcs, strlen(test.expected_lcs)) == 0;
     if (!success) {
@@ -261,13 +467,875 @@ TEST test_hirschberg_lcs_subproblem_correctness(void) {
     size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
     for (size_t i = 0; i < num_test_cases; i++) {
         lcs_test_t test = test_data_lcs[i];
-        ASSERT(test_hirschberg_subproblem_lcs(test));
+        ASSERT(test_hirschberg_subproblem_lcs(test, false, false));
+    }
+    PASS();
+}
+
+TEST test_hirschberg_lcs_levels_correctness(void) {
+    size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
+    for (size_t i = 0; i < num_test_cases; i++) {
+        lcs_test_t test = test_data_lcs[i];
+        ASSERT(test_hirschberg_subproblem_lcs(test, false, true));
+        ASSERT(test_hirschberg_subproblem_lcs(test, true, true));
+    }
+    PASS();
+}
+
+TEST test_hirschberg_lcs_lanes_correctness(void) {
+    size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
+    string_pair_input_t pairs[num_test_cases];
+    string_subproblem_array *results[num_test_cases];
+    size_t num_pairs = 0;
+    size_t test_index[num_test_cases];
+    for (size_t i = 0; i < num_test_cases; i++) {
+        const char *s1 = test_data_lcs[i].s1;
+        const char *s2 = test_data_lcs[i].s2;
+        size_t m = strlen(s1);
+        size_t n = strlen(s2);
+        // the built-in lanes kernel compares bytes
+        if (utf8_len(s1, m) != m || utf8_len(s2, n) != n) continue;
+        if (n > m) {
+            pairs[num_pairs] = (string_pair_input_t){.s1 = s2, .m = n, .s2 = s1, .n = m};
+        } else {
+            pairs[num_pairs] = (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n};
+        }
+        results[num_pairs] = string_subproblem_array_new();
+        test_index[num_pairs] = i;
+        num_pairs++;
+    }
+
+    ASSERT(hirschberg_uint32_sim_lanes_align(pairs, num_pairs,
+        (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true},
+        hirschberg_uint32_sim_lanes_unit_cost, NULL, NULL, NULL, results));
+
+    for (size_t p = 0; p < num_pairs; p++) {
+        const char *expected_lcs = test_data_lcs[test_index[p]].expected_lcs;
+        size_t max_len = pairs[p].m;
+        char *alignment = malloc(max_len + 1);
+        size_t idx = 0;
+        for (size_t i = 0; i < results[p]->n; i++) {
+            hirschberg_alignment_lcs_append(pairs[p].s1, pairs[p].s2, results[p]->a[i], alignment, &idx);
+        }
+        alignment[idx] = '\0';
+        bool success = strcmp(alignment, expected_lcs) == 0;
+        if (!success) {
+            printf("alignment: %s\n", alignment);
+            printf("expected: %s\n", expected_lcs);
+        }
+        free(alignment);
+        string_subproblem_array_destroy(results[p]);
+        ASSERT(success);
+    }
+    PASS();
+}
+
+TEST test_hirschberg_lanes_batch(void) {
+    // more pairs than lanes so lanes get refilled, checked against the scalar iterator
+    size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
+    string_pair_input_t pairs[4 * num_test_cases];
+    size_t num_pairs = 0;
+    for (size_t k = 0; k < 4; k++) {
+        for (size_t i = 0; i < num_test_cases; i++) {
+            const char *s1 = test_data_lcs[i].s1;
+            const char *s2 = test_data_lcs[(i + k) % num_test_cases].s2;
+            size_t m = strlen(s1);
+            size_t n = strlen(s2);
+            if (utf8_len(s1, m) != m || utf8_len(s2, n) != n) continue;
+            pairs[num_pairs++] = (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n};
+        }
+    }
+    // the uint16 instantiations run 16 lanes
+    ASSERT(num_pairs > 16);
+
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    string_subproblem_array *sim_results[num_pairs];
+    string_subproblem_array *dist_results[num_pairs];
+    for (size_t p = 0; p < num_pairs; p++) {
+        sim_results[p] = string_subproblem_array_new();
+        dist_results[p] = string_subproblem_array_new();
+    }
+    ASSERT(hirschberg_uint32_sim_lanes_align(pairs, num_pairs, options, hirschberg_uint32_sim_lanes_unit_cost, NULL, NULL, NULL, sim_results));
+    ASSERT(hirschberg_uint16_dist_lanes_align(pairs, num_pairs, options, hirschberg_uint16_dist_lanes_unit_cost, NULL, NULL, NULL, dist_results));
+
+    for (size_t p = 0; p < num_pairs; p++) {
+        size_t values_size = (pairs[p].n + 1) * 2;
+        hirschberg_uint64_sim_iter *sim_iter = hirschberg_uint64_sim_iter_new(pairs[p], options, hirschberg_uint64_sim_values_new(values_size),
+            hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+        size_t idx = 0;
+        while (hirschberg_uint64_sim_iter_next(sim_iter)) {
+            if (!sim_iter->is_result) continue;
+            ASSERT(idx < sim_results[p]->n);
+            ASSERT(memcmp(&sim_iter->sub, &sim_results[p]->a[idx++], sizeof(string_subproblem_t)) == 0);
+        }
+        ASSERT_EQ(idx, sim_results[p]->n);
+        hirschberg_uint64_sim_iter_destroy(sim_iter);
+
+        hirschberg_uint64_dist_iter *dist_iter = hirschberg_uint64_dist_iter_new(pairs[p], options, hirschberg_uint64_dist_values_new(values_size),
+            hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, NULL));
+        idx = 0;
+        while (hirschberg_uint64_dist_iter_next(dist_iter)) {
+            if (!dist_iter->is_result) continue;
+            ASSERT(idx < dist_results[p]->n);
+            ASSERT(memcmp(&dist_iter->sub, &dist_results[p]->a[idx++], sizeof(string_subproblem_t)) == 0);
+        }
+        ASSERT_EQ(idx, dist_results[p]->n);
+        hirschberg_uint64_dist_iter_destroy(dist_iter);
+
+        string_subproblem_array_destroy(sim_results[p]);
+        string_subproblem_array_destroy(dist_results[p]);
+    }
+
+    // the built-in lanes kernel compares bytes, so UTF-8 input is refused
+    options.utf8 = true;
+    ASSERT(!hirschberg_uint32_sim_lanes_align(pairs, 1, options, hirschberg_uint32_sim_lanes_unit_cost, NULL, NULL, NULL, sim_results));
+    options.utf8 = false;
+
+    // m + n beyond uint16 goes to the scalar path, refused without a scalar kernel
+    size_t long_m = 65000;
+    size_t long_n = 600;
+    char *long_s1 = malloc(long_m);
+    char *long_s2 = malloc(long_n);
+    for (size_t i = 0; i < long_m; i++) long_s1[i] = "acgt"[(i * 7 + i / 5) % 4];
+    for (size_t j = 0; j < long_n; j++) long_s2[j] = "acgt"[(j * 3 + j / 7) % 4];
+    string_pair_input_t long_pairs[2] = {
+        pairs[0],
+        (string_pair_input_t){.s1 = long_s1, .m = long_m, .s2 = long_s2, .n = long_n}
+    };
+    string_subproblem_array *long_results[2] = {string_subproblem_array_new(), string_subproblem_array_new()};
+    ASSERT(!hirschberg_uint16_dist_lanes_align(long_pairs, 2, options, hirschberg_uint16_dist_lanes_unit_cost, NULL, NULL, NULL, long_results));
+    string_subproblem_array_clear(long_results[0]);
+    string_subproblem_array_clear(long_results[1]);
+    hirschberg_uint16_dist_values_t *scalar_values = hirschberg_uint16_dist_values_new(hirschberg_uint16_dist_tiled_values_size(long_m, long_n));
+    hirschberg_uint16_dist_function_t *scalar_function = hirschberg_uint16_dist_function_new_options(hirschberg_uint16_dist_tiled_values, NULL);
+    ASSERT(hirschberg_uint16_dist_lanes_align(long_pairs, 2, options, hirschberg_uint16_dist_lanes_unit_cost, NULL,
+        scalar_values, scalar_function, long_results));
+
+    hirschberg_uint64_dist_iter *long_iter = hirschberg_uint64_dist_iter_new(long_pairs[1], options, hirschberg_uint64_dist_values_new((long_n + 1) * 2),
+        hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, NULL));
+    size_t idx = 0;
+    while (hirschberg_uint64_dist_iter_next(long_iter)) {
+        if (!long_iter->is_result) continue;
+        ASSERT(idx < long_results[1]->n);
+        ASSERT(memcmp(&long_iter->sub, &long_results[1]->a[idx++], sizeof(string_subproblem_t)) == 0);
+    }
+    ASSERT_EQ(idx, long_results[1]->n);
+    ASSERT(long_results[0]->n > 0);
+    hirschberg_uint64_dist_iter_destroy(long_iter);
+    hirschberg_uint16_dist_values_destroy(scalar_values);
+    free(scalar_function);
+    string_subproblem_array_destroy(long_results[0]);
+    string_subproblem_array_destroy(long_results[1]);
+    free(long_s1);
+    free(long_s2);
+    PASS();
+}
+
+size_t test_hirschberg_prepared_lcs_split(const char *s1_chars, size_t m, const char *s2_chars, size_t n, const uint64_t *forward_costs, size_t forward_size, uint64_t *costs, size_t costs_size, uint64_t *opt_value, void *options) {
+    // prepared kernels get codepoints through the char pointers
+    const int32_t *s1 = (const int32_t *)(const void *)s1_chars;
+    const int32_t *s2 = (const int32_t *)(const void *)s2_chars;
+    uint64_t *lcs = costs;
+    if (forward_size != n + 1 || costs_size < n + 1) return n;
+    for (size_t k = 0; k <= n; k++) {
+        lcs[k] = 0;
+    }
+    for (size_t i = 1; i <= m; i++) {
+        uint64_t diag = 0;
+        for (size_t j = 1; j <= n; j++) {
+            uint64_t up = lcs[j];
+            if (s1[m - i] == s2[n - j]) {
+                lcs[j] = diag + 1;
+            } else if (up < lcs[j - 1]) {
+                lcs[j] = lcs[j - 1];
+            }
+            diag = up;
+        }
+    }
+    size_t sub_n = n;
+    uint64_t opt = 0;
+    for (size_t k = 0; k <= n; k++) {
+        uint64_t value = forward_costs[n - k] + lcs[k];
+        if (k == 0 || value > opt) {
+            opt = value;
+            sub_n = n - k;
+        }
+    }
+    *opt_value = opt;
+    return sub_n;
+}
+
+bool test_hirschberg_prepared_lcs(lcs_test_t test, bool fused) {
+    size_t m = strlen(test.s1);
+    size_t n = strlen(test.s2);
+    bool is_utf8 = utf8_len(test.s1, m) != m || utf8_len(test.s2, n) != n;
+
+    hirschberg_prepared_string_t *s1 = hirschberg_prepared_string_new(test.s1, m, is_utf8);
+    hirschberg_prepared_string_t *s2 = hirschberg_prepared_string_new(test.s2, n, is_utf8);
+    if (s1->len < s2->len) {
+        hirschberg_prepared_string_t *tmp = s1;
+        s1 = s2;
+        s2 = tmp;
+    }
+    hirschberg_prepared_string_t *expected = hirschberg_prepared_string_new(test.expected_lcs, strlen(test.expected_lcs), is_utf8);
+
+    // offsets map each codepoint back to the source bytes it came from
+    const char *s1_source = s1->offsets[s1->len] == m ? test.s1 : test.s2;
+    for (size_t i = 0; i < s1->len; i++) {
+        if (s1->offsets[i] >= s1->offsets[i + 1]) return false;
+        int32_t c = 0;
+        utf8proc_iterate((const unsigned char *)s1_source + s1->offsets[i], -1, &c);
+        if (utf8proc_tolower(c) != s1->codepoints[i]) return false;
+    }
+
+    hirschberg_uint64_sim_function_t *function = hirschberg_uint64_sim_function_new_prepared(hirschberg_uint64_sim_prepared_unit_cost);
+    if (fused) hirschberg_uint64_sim_function_set_split(function, test_hirschberg_prepared_lcs_split);
+    hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new_prepared(s1, s2,
+        (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true},
+        hirschberg_uint64_sim_values_new((s2->len + 1) * 2),
+        function
+    );
+
+    int32_t *alignment = malloc(sizeof(int32_t) * (s1->len + 1));
+    size_t idx = 0;
+    while (hirschberg_uint64_sim_iter_next(iter)) {
+        if (!iter->is_result) continue;
+        string_subproblem_t sub = iter->sub;
+        if (sub.m == 0 || sub.n == 0) continue;
+        // leaves have a single codepoint on at least one side, keep it if the other side contains it
+        const int32_t *single = sub.m == 1 ? s1->codepoints + sub.x : s2->codepoints + sub.y;
+        const int32_t *other = sub.m == 1 ? s2->codepoints + sub.y : s1->codepoints + sub.x;
+        size_t other_len = sub.m == 1 ? sub.n : sub.m;
+        for (size_t j = 0; j < other_len; j++) {
+            if (other[j] == *single) {
+                alignment[idx++] = *single;
+                break;
+            }
+        }
+    }
+
+    bool success = idx == expected->len && memcmp(alignment, expected->codepoints, sizeof(int32_t) * idx) == 0;
+    if (!success) {
+        printf("prepared alignment mismatch for s1: %s, s2: %s\n", test.s1, test.s2);
+    }
+
+    free(alignment);
+    hirschberg_uint64_sim_iter_destroy(iter);
+    hirschberg_prepared_string_destroy(s1);
+    hirschberg_prepared_string_destroy(s2);
+    hirschberg_prepared_string_destroy(expected);
+    return success;
+}
+
+TEST test_hirschberg_lcs_prepared_correctness(void) {
+    size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
+    for (size_t i = 0; i < num_test_cases; i++) {
+        lcs_test_t test = test_data_lcs[i];
+        ASSERT(test_hirschberg_prepared_lcs(test, false));
+        ASSERT(test_hirschberg_prepared_lcs(test, true));
+    }
+    PASS();
+}
+
+TEST test_hirschberg_local_alignment(void) {
+    const char *s1 = "xxxxxhello worldyyyyy";
+    const char *s2 = "zzzhello worldzzz";
+    size_t m = strlen(s1);
+    size_t n = strlen(s2);
+    string_pair_input_t input = (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n};
+
+    hirschberg_uint64_sim_values_t *values = hirschberg_uint64_sim_values_new((n + 1) * 2);
+    string_subproblem_t window;
+    uint64_t score = 0;
+    ASSERT(hirschberg_uint64_sim_local_window(input, values, test_hirschberg_local_cost, NULL, &window, &score));
+    ASSERT_EQ(score, 22);
+    ASSERT_EQ(window.x, 5);
+    ASSERT_EQ(window.m, 11);
+    ASSERT_EQ(window.y, 3);
+    ASSERT_EQ(window.n, 11);
+
+    // repeated matches: the window is the first one, not a span covering both
+    string_pair_input_t repeated = (string_pair_input_t){.s1 = "AB", .m = 2, .s2 = "ABzzAB", .n = 6};
+    ASSERT(hirschberg_uint64_sim_local_window(repeated, values, test_hirschberg_local_cost, NULL, &window, &score));
+    ASSERT_EQ(score, 4);
+    ASSERT_EQ(window.x, 0);
+    ASSERT_EQ(window.m, 2);
+    ASSERT_EQ(window.y, 0);
+    ASSERT_EQ(window.n, 2);
+
+    hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new_local(input,
+        (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true},
+        values,
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost),
+        test_hirschberg_local_cost, NULL
+    );
+    char *alignment = hirschberg_alignment_lcs(iter, m);
+    bool success = strcmp(alignment, "hello world") == 0;
+    if (!success) {
+        printf("alignment: %s\n", alignment);
+    }
+    free(alignment);
+    hirschberg_uint64_sim_iter_destroy(iter);
+    ASSERT(success);
+    PASS();
+}
+
+TEST test_hirschberg_negative_split_scores(void) {
+    // the global pass inside the local window has splits whose every sum is negative,
+    // so split selection can't start from a floor of 0
+    const char *s1 = "dbdbcaaacadcbaacb";
+    const char *s2 = "cdccadbccbbbbaacdbad";
+    size_t m = strlen(s1);
+    size_t n = strlen(s2);
+    string_pair_input_t input = (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n};
+    hirschberg_double_sim_values_t *values = hirschberg_double_sim_values_new((n + 1) * 2);
+    hirschberg_double_sim_function_t *function = hirschberg_double_sim_function_new(test_hirschberg_signed_global_cost);
+
+    string_subproblem_t window;
+    double best = 0;
+    ASSERT(hirschberg_double_sim_local_window(input, values, test_hirschberg_signed_local_cost, NULL, &window, &best));
+    ASSERT_EQ(best, 12);
+
+    hirschberg_double_sim_iter *iter = hirschberg_double_sim_iter_new_local(input,
+        (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true},
+        values, function, test_hirschberg_signed_local_cost, NULL);
+    // the traced alignment scores as much as the best local score: sum the exact global score of each leaf
+    double traced = 0;
+    double leaf_values[2 * (n + 1)];
+    while (hirschberg_double_sim_iter_next(iter)) {
+        if (!iter->is_result) continue;
+        string_subproblem_t leaf = iter->sub;
+        test_hirschberg_signed_global_cost(s1 + leaf.x, leaf.m, s2 + leaf.y, leaf.n, false, leaf_values, 2 * (n + 1));
+        traced += leaf_values[leaf.n];
+    }
+    ASSERT(iter->has_score);
+    ASSERT_EQ(iter->score, 12);
+    ASSERT_EQ(traced, 12);
+    iter->values_function = NULL;
+    hirschberg_double_sim_iter_destroy(iter);
+    free(function);
+    PASS();
+}
+
+TEST test_hirschberg_fitting_alignment(void) {
+    const char *s1 = "quick";
+    const char *s2 = "the quick brown fox";
+    size_t m = strlen(s1);
+    size_t n = strlen(s2);
+    string_pair_input_t input = (string_pair_input_t){.s1 = s1, .m = m, .s2 = s2, .n = n};
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+
+    static bool free_s2_gaps = true;
+    hirschberg_uint64_dist_values_t *values = hirschberg_uint64_dist_values_new((n + 1) * 2);
+    hirschberg_uint64_dist_function_t *fitting_function = hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, &free_s2_gaps);
+    string_subproblem_t window;
+    uint64_t score = 1;
+    ASSERT(hirschberg_uint64_dist_fitting_window(input, options, values, fitting_function, &window, &score));
+    ASSERT_EQ(score, 0);
+    ASSERT_EQ(window.x, 0);
+    ASSERT_EQ(window.m, m);
+    ASSERT_EQ(window.y, 4);
+    ASSERT_EQ(window.n, m);
+
+    hirschberg_uint64_dist_iter *iter = hirschberg_uint64_dist_iter_new_fitting(input, options, values,
+        hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, NULL),
+        fitting_function
+    );
+    size_t num_results = 0;
+    while (hirschberg_uint64_dist_iter_next(iter)) {
+        if (!iter->is_result) continue;
+        string_subproblem_t sub = iter->sub;
+        ASSERT(sub.m == 1 && sub.n == 1);
+        ASSERT_EQ(s1[sub.x], s2[sub.y]);
+        num_results++;
+    }
+    ASSERT_EQ(num_results, m);
+    free(fitting_function);
+    hirschberg_uint64_dist_iter_destroy(iter);
+    PASS();
+}
+
+uint64_t test_hirschberg_lcs_score(const char *s1, size_t m, const char *s2, size_t n) {
+    uint64_t *costs = calloc(2 * (n + 1), sizeof(uint64_t));
+    test_hirschberg_lcs_cost(s1, m, s2, n, false, costs, 2 * (n + 1));
+    uint64_t score = costs[n];
+    free(costs);
+    return score;
+}
+
+// Aligns (s1, s2), applies edit (replacing its old_len bytes with text), re-aligns incrementally and
+// checks the leaves tile the edited grid and score as much as aligning the edited strings from scratch
+bool test_hirschberg_realign_case(const char *s1, const char *s2, hirschberg_edit_t edit, const char *text) {
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    string_pair_input_t old_input = (string_pair_input_t){.s1 = s1, .m = strlen(s1), .s2 = s2, .n = strlen(s2)};
+
+    const char *edited = edit.in_s2 ? s2 : s1;
+    size_t edited_len = strlen(edited);
+    char *new_str = malloc(edited_len - edit.old_len + edit.new_len + 1);
+    memcpy(new_str, edited, edit.start);
+    memcpy(new_str + edit.start, text, edit.new_len);
+    strcpy(new_str + edit.start + edit.new_len, edited + edit.start + edit.old_len);
+    string_pair_input_t input = old_input;
+    if (edit.in_s2) {
+        input.s2 = new_str;
+        input.n = strlen(new_str);
+    } else {
+        input.s1 = new_str;
+        input.m = strlen(new_str);
+    }
+
+    size_t max_n = old_input.n > input.n ? old_input.n : input.n;
+    hirschberg_uint64_sim_values_t *values = hirschberg_uint64_sim_values_new((max_n + 1) * 2);
+    hirschberg_uint64_sim_function_t *function = hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost);
+
+    string_subproblem_array *previous = string_subproblem_array_new();
+    hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new(old_input, options, values, function);
+    while (hirschberg_uint64_sim_iter_next(iter)) {
+        if (iter->is_result) string_subproblem_array_push(previous, iter->sub);
+    }
+    iter->values = NULL;
+    iter->values_function = NULL;
+    hirschberg_uint64_sim_iter_destroy(iter);
+
+    string_subproblem_array *results = string_subproblem_array_new();
+    bool success = hirschberg_uint64_sim_realign(input, options, values, function, previous, edit, 1, results);
+
+    // leaves must tile the edited grid in order
+    size_t x = 0, y = 0;
+    uint64_t score = 0;
+    for (size_t i = 0; success && i < results->n; i++) {
+        string_subproblem_t sub = results->a[i];
+        success = sub.x == x && sub.y == y && sub.m + sub.n > 0;
+        x += sub.m;
+        y += sub.n;
+        score += test_hirschberg_lcs_score(input.s1 + sub.x, sub.m, input.s2 + sub.y, sub.n);
+    }
+    success = success && x == input.m && y == input.n;
+    uint64_t expected = test_hirschberg_lcs_score(input.s1, input.m, input.s2, input.n);
+    if (!success || score != expected) {
+        printf("realign of \"%s\" / \"%s\": tiled %d, score %llu, expected %llu\n", input.s1, input.s2, (int)success,
+               (unsigned long long)score, (unsigned long long)expected);
+        success = false;
+    }
+
+    free(new_str);
+    free(function);
+    hirschberg_uint64_sim_values_destroy(values);
+    string_subproblem_array_destroy(previous);
+    string_subproblem_array_destroy(results);
+    return success;
+}
+
+TEST test_hirschberg_incremental_realign(void) {
+    const char *s1 = "the quick brown fox jumps over the lazy dog";
+    const char *s2 = "a quick brown fox jumped over a lazy dog";
+    size_t m = strlen(s1);
+    size_t n = strlen(s2);
+
+    // replacement in the middle
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = false, .start = 16, .old_len = 3, .new_len = 3}, "cat"));
+    // insertion
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = false, .start = 4, .old_len = 0, .new_len = 5}, "very "));
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = true, .start = 18, .old_len = 0, .new_len = 4}, "ing "));
+    // deletion
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = true, .start = 8, .old_len = 6, .new_len = 0}, ""));
+    // edits at the boundaries
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = false, .start = 0, .old_len = 3, .new_len = 1}, "a"));
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = true, .start = n - 3, .old_len = 3, .new_len = 3}, "cat"));
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = false, .start = m, .old_len = 0, .new_len = 4}, "!!!!"));
+    // a whole side deleted, the window becomes a single gap
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = false, .start = 0, .old_len = m, .new_len = 0}, ""));
+    ASSERT(test_hirschberg_realign_case(s1, s2, (hirschberg_edit_t){.in_s2 = true, .start = 0, .old_len = n, .new_len = 0}, ""));
+
+    // prepared inputs carry no strings and can't be re-aligned
+    hirschberg_uint64_sim_values_t *values = hirschberg_uint64_sim_values_new((n + 1) * 2);
+    hirschberg_uint64_sim_function_t *function = hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost);
+    string_subproblem_array *previous = string_subproblem_array_new();
+    string_subproblem_array *results = string_subproblem_array_new();
+    string_pair_input_t prepared_input = (string_pair_input_t){.s1 = NULL, .m = m, .s2 = NULL, .n = n};
+    hirschberg_edit_t edit = (hirschberg_edit_t){.in_s2 = false, .start = 16, .old_len = 3, .new_len = 3};
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    ASSERT(!hirschberg_uint64_sim_realign(prepared_input, options, values, function, previous, edit, 1, results));
+    free(function);
+    hirschberg_uint64_sim_values_destroy(values);
+    string_subproblem_array_destroy(previous);
+    string_subproblem_array_destroy(results);
+    PASS();
+}
+
+TEST test_hirschberg_four_russians(void) {
+    const char *pairs[][2] = {
+        {"GTCGTAGAATA", "CACGTAGTA"},
+        {"ACGTTGCAAGTCCGATAGCTTAGGCATCGATCGGATTACAGT", "ACGTGCAAGTCGATAGCTAGGCATTCGATCGATTACAG"},
+        {"ttagcatgcaagtc", "TTGCATGGCAAGC"}
+    };
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    hirschberg_four_russians_t *lcs_tables = hirschberg_four_russians_new("ACGT", 3, HIRSCHBERG_FOUR_RUSSIANS_LCS);
+    hirschberg_four_russians_t *levenshtein_tables = hirschberg_four_russians_new("ACGT", 2, HIRSCHBERG_FOUR_RUSSIANS_LEVENSHTEIN);
+    ASSERT(lcs_tables != NULL && levenshtein_tables != NULL);
+
+    for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); p++) {
+        string_pair_input_t input = (string_pair_input_t){.s1 = pairs[p][0], .m = strlen(pairs[p][0]), .s2 = pairs[p][1], .n = strlen(pairs[p][1])};
+        size_t values_size = (input.n + 1) * 2;
+
+        // leaves must match the ones from the plain row kernels exactly
+        hirschberg_uint64_sim_iter *sim_iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+            hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+        hirschberg_uint64_sim_iter *sim_blocks = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+            hirschberg_uint64_sim_function_new_options(hirschberg_uint64_sim_four_russians_values, lcs_tables));
+        while (hirschberg_uint64_sim_iter_next(sim_iter)) {
+            ASSERT(hirschberg_uint64_sim_iter_next(sim_blocks));
+            ASSERT(memcmp(&sim_iter->sub, &sim_blocks->sub, sizeof(string_subproblem_t)) == 0);
+        }
+        ASSERT(!hirschberg_uint64_sim_iter_next(sim_blocks));
+        hirschberg_uint64_sim_iter_destroy(sim_iter);
+        hirschberg_uint64_sim_iter_destroy(sim_blocks);
+
+        hirschberg_uint64_dist_iter *dist_iter = hirschberg_uint64_dist_iter_new(input, options, hirschberg_uint64_dist_values_new(values_size),
+            hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, NULL));
+        hirschberg_uint64_dist_iter *dist_blocks = hirschberg_uint64_dist_iter_new(input, options, hirschberg_uint64_dist_values_new(values_size),
+            hirschberg_uint64_dist_function_new_options(hirschberg_uint64_dist_four_russians_values, levenshtein_tables));
+        while (hirschberg_uint64_dist_iter_next(dist_iter)) {
+            ASSERT(hirschberg_uint64_dist_iter_next(dist_blocks));
+            ASSERT(memcmp(&dist_iter->sub, &dist_blocks->sub, sizeof(string_subproblem_t)) == 0);
+        }
+        ASSERT(!hirschberg_uint64_dist_iter_next(dist_blocks));
+        hirschberg_uint64_dist_iter_destroy(dist_iter);
+        hirschberg_uint64_dist_iter_destroy(dist_blocks);
+    }
+
+    // a character outside the alphabet is caught up front, and the kernel's failure stops the iterator
+    string_pair_input_t outside = (string_pair_input_t){.s1 = "ACGTNACGT", .m = 9, .s2 = "ACGTACGT", .n = 8};
+    ASSERT(!hirschberg_four_russians_accepts(lcs_tables, outside.s1, outside.m));
+    ASSERT(hirschberg_four_russians_accepts(lcs_tables, outside.s2, outside.n));
+    hirschberg_uint64_sim_values_t *outside_values = hirschberg_uint64_sim_values_new((outside.n + 1) * 2);
+    hirschberg_uint64_sim_function_t *outside_function = hirschberg_uint64_sim_function_new_options(hirschberg_uint64_sim_four_russians_values, lcs_tables);
+    hirschberg_uint64_sim_iter *outside_iter = hirschberg_uint64_sim_iter_new(outside, options, outside_values, outside_function);
+    ASSERT(!hirschberg_uint64_sim_iter_next(outside_iter));
+    ASSERT(outside_iter->failed);
+    ASSERT(!outside_iter->has_score);
+    hirschberg_uint64_sim_iter_destroy(outside_iter);
+    string_subproblem_array *outside_leaves = string_subproblem_array_new();
+    outside_iter = hirschberg_uint64_sim_iter_new(outside, options, hirschberg_uint64_sim_values_new((outside.n + 1) * 2),
+        hirschberg_uint64_sim_function_new_options(hirschberg_uint64_sim_four_russians_values, lcs_tables));
+    ASSERT(!hirschberg_uint64_sim_iter_run_levels(outside_iter, 2, outside_leaves));
+    ASSERT(outside_iter->failed);
+    hirschberg_uint64_sim_iter_destroy(outside_iter);
+    string_subproblem_array_destroy(outside_leaves);
+
+    hirschberg_four_russians_destroy(lcs_tables);
+    hirschberg_four_russians_destroy(levenshtein_tables);
+
+    // (3 * sigma)^(2t) entries: t = 4 is over the default cap for DNA but fits a binary alphabet
+    ASSERT(hirschberg_four_russians_new("ACGT", 4, HIRSCHBERG_FOUR_RUSSIANS_LCS) == NULL);
+    hirschberg_four_russians_t *binary_tables = hirschberg_four_russians_new("01", 4, HIRSCHBERG_FOUR_RUSSIANS_LCS);
+    ASSERT(binary_tables != NULL);
+    hirschberg_four_russians_destroy(binary_tables);
+    PASS();
+}
+
+TEST test_hirschberg_tiled(void) {
+    const char *s1 = "Brooklyn Academy of Music 30 Lafayette Avenue Brooklyn New York";
+    const char *s2 = "bam 30 lafyette ave bk new yORk 11217";
+    string_pair_input_t input = (string_pair_input_t){.s1 = s1, .m = strlen(s1), .s2 = s2, .n = strlen(s2)};
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    size_t values_size = (input.n + 1) * 2;
+    // narrow strips so the top-level passes cross several strip boundaries
+    hirschberg_tiled_options_t tiled_options = (hirschberg_tiled_options_t){.strip_width = 5};
+    // the boundary column goes after the row in values
+    size_t tiled_size = hirschberg_uint64_sim_tiled_values_size(input.m, input.n);
+    uint64_t *row = malloc(sizeof(uint64_t) * tiled_size);
+    ASSERT_EQ(hirschberg_uint64_sim_tiled_values(s1, input.m, s2, input.n, false, row, input.n + 1, &tiled_options), 0);
+    ASSERT_EQ(hirschberg_uint64_sim_tiled_values(s1, input.m, s2, input.n, false, row, tiled_size, &tiled_options), input.n + 1);
+    free(row);
+
+    hirschberg_uint64_sim_iter *sim_iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    hirschberg_uint64_sim_iter *sim_tiled = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(tiled_size),
+        hirschberg_uint64_sim_function_new_options(hirschberg_uint64_sim_tiled_values, &tiled_options));
+    while (hirschberg_uint64_sim_iter_next(sim_iter)) {
+        ASSERT(hirschberg_uint64_sim_iter_next(sim_tiled));
+        ASSERT(memcmp(&sim_iter->sub, &sim_tiled->sub, sizeof(string_subproblem_t)) == 0);
+    }
+    ASSERT(!hirschberg_uint64_sim_iter_next(sim_tiled));
+    hirschberg_uint64_sim_iter_destroy(sim_iter);
+    hirschberg_uint64_sim_iter_destroy(sim_tiled);
+
+    hirschberg_uint64_dist_iter *dist_iter = hirschberg_uint64_dist_iter_new(input, options, hirschberg_uint64_dist_values_new(values_size),
+        hirschberg_uint64_dist_function_new_options(test_hirschberg_levenshtein_cost, NULL));
+    hirschberg_uint64_dist_iter *dist_tiled = hirschberg_uint64_dist_iter_new(input, options, hirschberg_uint64_dist_values_new(tiled_size),
+        hirschberg_uint64_dist_function_new_options(hirschberg_uint64_dist_tiled_values, &tiled_options));
+    while (hirschberg_uint64_dist_iter_next(dist_iter)) {
+        ASSERT(hirschberg_uint64_dist_iter_next(dist_tiled));
+        ASSERT(memcmp(&dist_iter->sub, &dist_tiled->sub, sizeof(string_subproblem_t)) == 0);
+    }
+    ASSERT(!hirschberg_uint64_dist_iter_next(dist_tiled));
+    hirschberg_uint64_dist_iter_destroy(dist_iter);
+    hirschberg_uint64_dist_iter_destroy(dist_tiled);
+    PASS();
+}
+
+TEST test_hirschberg_checkpoint_resume(void) {
+    const char *s1 = "bam 30 lafyette ave bk new yORk 11217";
+    const char *s2 = "Brooklyn Academy of Music 30 Lafayette Avenue Brooklyn New York";
+    string_pair_input_t input = (string_pair_input_t){.s1 = s2, .m = strlen(s2), .s2 = s1, .n = strlen(s1)};
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    size_t values_size = (input.n + 1) * 2;
+
+    string_subproblem_array *expected = string_subproblem_array_new();
+    hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    while (hirschberg_uint64_sim_iter_next(iter)) {
+        if (iter->is_result) string_subproblem_array_push(expected, iter->sub);
+    }
+    ASSERT(iter->has_score);
+    uint64_t expected_score = iter->score;
+    hirschberg_uint64_sim_iter_destroy(iter);
+
+    // stop part way, checkpoint, and finish from the checkpoint
+    string_subproblem_array *results = string_subproblem_array_new();
+    iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    for (size_t i = 0; i < 20 && hirschberg_uint64_sim_iter_next(iter); i++) {
+        if (iter->is_result) string_subproblem_array_push(results, iter->sub);
+    }
+    FILE *f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT(hirschberg_uint64_sim_iter_save(iter, f));
+    hirschberg_uint64_sim_iter_destroy(iter);
+    rewind(f);
+    iter = hirschberg_uint64_sim_iter_resume(f, input, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    fclose(f);
+    ASSERT(iter != NULL);
+    // the root was split before the checkpoint, its score comes from the file
+    ASSERT(iter->has_score);
+    ASSERT_EQ(iter->score, expected_score);
+    while (hirschberg_uint64_sim_iter_next(iter)) {
+        if (iter->is_result) string_subproblem_array_push(results, iter->sub);
+    }
+    hirschberg_uint64_sim_iter_destroy(iter);
+    ASSERT_EQ(results->n, expected->n);
+    ASSERT(memcmp(results->a, expected->a, sizeof(string_subproblem_t) * expected->n) == 0);
+
+    // partition into independent jobs and concatenate their results
+    string_subproblem_array_clear(results);
+    iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    const char *tmp_dir = getenv("TMPDIR");
+    char job_dir[256];
+    snprintf(job_dir, sizeof(job_dir), "%s/hirschberg_jobs_XXXXXX", tmp_dir != NULL ? tmp_dir : "/tmp");
+    ASSERT(mkdtemp(job_dir) != NULL);
+    char job_prefix[288];
+    snprintf(job_prefix, sizeof(job_prefix), "%s/job", job_dir);
+    size_t num_jobs = 0;
+    ASSERT(hirschberg_uint64_sim_iter_write_jobs(iter, 3, 2, job_prefix, &num_jobs));
+    hirschberg_uint64_sim_iter_destroy(iter);
+    ASSERT(num_jobs > 1 && num_jobs <= 8);
+    for (size_t i = 0; i < num_jobs; i++) {
+        char path[320];
+        snprintf(path, sizeof(path), "%s.%zu", job_prefix, i);
+        f = fopen(path, "rb");
+        ASSERT(f != NULL);
+        iter = hirschberg_uint64_sim_iter_resume(f, input, hirschberg_uint64_sim_values_new(values_size),
+            hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+        fclose(f);
+        remove(path);
+        ASSERT(iter != NULL);
+        ASSERT(iter->has_score);
+        ASSERT_EQ(iter->score, expected_score);
+        while (hirschberg_uint64_sim_iter_next(iter)) {
+            if (iter->is_result) string_subproblem_array_push(results, iter->sub);
+        }
+        hirschberg_uint64_sim_iter_destroy(iter);
+    }
+    rmdir(job_dir);
+    ASSERT_EQ(results->n, expected->n);
+    ASSERT(memcmp(results->a, expected->a, sizeof(string_subproblem_t) * expected->n) == 0);
+
+    // prepared iterators have no byte strings to checkpoint
+    hirschberg_prepared_string_t *prepared_s1 = hirschberg_prepared_string_new(input.s1, input.m, false);
+    hirschberg_prepared_string_t *prepared_s2 = hirschberg_prepared_string_new(input.s2, input.n, false);
+    iter = hirschberg_uint64_sim_iter_new_prepared(prepared_s1, prepared_s2, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new_prepared(hirschberg_uint64_sim_prepared_unit_cost));
+    ASSERT(iter != NULL);
+    f = tmpfile();
+    ASSERT(f != NULL);
+    ASSERT(!hirschberg_uint64_sim_iter_save(iter, f));
+    fclose(f);
+    ASSERT(!hirschberg_uint64_sim_iter_write_jobs(iter, 2, 2, job_prefix, &num_jobs));
+    hirschberg_uint64_sim_iter_destroy(iter);
+    hirschberg_prepared_string_destroy(prepared_s1);
+    hirschberg_prepared_string_destroy(prepared_s2);
+
+    string_subproblem_array_destroy(expected);
+    string_subproblem_array_destroy(results);
+    PASS();
+}
+
+TEST test_hirschberg_result_cache(void) {
+    const char *s1 = "bam 30 lafyette ave bk new yORk 11217";
+    const char *s2 = "Brooklyn Academy of Music 30 Lafayette Avenue Brooklyn New York";
+    const char *s3 = "Brooklyn Academy of Music";
+    string_pair_input_t input = (string_pair_input_t){.s1 = s2, .m = strlen(s2), .s2 = s1, .n = strlen(s1)};
+    string_pair_input_t other = (string_pair_input_t){.s1 = s3, .m = strlen(s3), .s2 = s1, .n = strlen(s1)};
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = false, .allow_transpose = false, .init_values_zero = true};
+    size_t values_size = (input.n + 1) * 2;
+
+    string_subproblem_array *expected = string_subproblem_array_new();
+    hirschberg_uint64_sim_iter *iter = hirschberg_uint64_sim_iter_new(input, options, hirschberg_uint64_sim_values_new(values_size),
+        hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost));
+    while (hirschberg_uint64_sim_iter_next(iter)) {
+        if (iter->is_result) string_subproblem_array_push(expected, iter->sub);
+    }
+    ASSERT(iter->has_score);
+    uint64_t expected_score = iter->score;
+    hirschberg_uint64_sim_iter_destroy(iter);
+
+    hirschberg_uint64_sim_cache_t *cache = hirschberg_uint64_sim_cache_new(1);
+    ASSERT(cache != NULL);
+    hirschberg_uint64_sim_values_t *values = hirschberg_uint64_sim_values_new(values_size);
+    hirschberg_uint64_sim_function_t *function = hirschberg_uint64_sim_function_new(test_hirschberg_lcs_cost);
+    string_subproblem_array *results = string_subproblem_array_new();
+    uint64_t score = 0;
+    bool has_score = false;
+
+    // miss, then hit for the same pair
+    for (size_t i = 0; i < 2; i++) {
+        string_subproblem_array_clear(results);
+        ASSERT(hirschberg_uint64_sim_cache_align(cache, input, options, values, function, 0, results, &score, &has_score));
+        ASSERT(has_score);
+        ASSERT_EQ(score, expected_score);
+        ASSERT_EQ(results->n, expected->n);
+        ASSERT(memcmp(results->a, expected->a, sizeof(string_subproblem_t) * expected->n) == 0);
+    }
+    hirschberg_cache_stats_t stats = hirschberg_uint64_sim_cache_stats(cache);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.insertions, 1);
+
+    // different options are a different key
+    hirschberg_options_t utf8_options = options;
+    utf8_options.utf8 = true;
+    ASSERT(!hirschberg_uint64_sim_cache_get(cache, input, utf8_options, function, NULL, NULL, NULL));
+
+    // a second pair evicts the first from a cache of size 1
+    string_subproblem_array_clear(results);
+    ASSERT(hirschberg_uint64_sim_cache_align(cache, other, options, values, function, 2, results, &score, &has_score));
+    ASSERT(!hirschberg_uint64_sim_cache_get(cache, input, options, function, NULL, NULL, NULL));
+    stats = hirschberg_uint64_sim_cache_stats(cache);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 4);
+    ASSERT_EQ(stats.evictions, 1);
+
+    // kernels with options are only cached once they have an id, and different ids don't share entries
+    int lcs_options = 0;
+    hirschberg_uint64_sim_function_t *options_function = hirschberg_uint64_sim_function_new_options(test_hirschberg_lcs_options_cost, &lcs_options);
+    string_subproblem_array_clear(results);
+    ASSERT(hirschberg_uint64_sim_cache_align(cache, input, options, values, options_function, 0, results, &score, &has_score));
+    ASSERT_EQ(score, expected_score);
+    ASSERT(!hirschberg_uint64_sim_cache_put(cache, input, options, options_function, results, score, has_score));
+    stats = hirschberg_uint64_sim_cache_stats(cache);
+    ASSERT_EQ(stats.misses, 4);
+    ASSERT_EQ(stats.insertions, 2);
+    hirschberg_uint64_sim_function_set_cache_id(options_function, 1);
+    for (size_t i = 0; i < 2; i++) {
+        string_subproblem_array_clear(results);
+        ASSERT(hirschberg_uint64_sim_cache_align(cache, input, options, values, options_function, 0, results, &score, &has_score));
+        ASSERT_EQ(results->n, expected->n);
+    }
+    hirschberg_uint64_sim_function_set_cache_id(options_function, 2);
+    ASSERT(!hirschberg_uint64_sim_cache_get(cache, input, options, options_function, NULL, NULL, NULL));
+    stats = hirschberg_uint64_sim_cache_stats(cache);
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 6);
+    ASSERT_EQ(stats.insertions, 3);
+
+    hirschberg_uint64_sim_cache_destroy(cache);
+    hirschberg_uint64_sim_values_destroy(values);
+    free(function);
+    free(options_function);
+
+    // batch entry point, the repeated pair in the second batch is answered from the cache
+    hirschberg_uint32_sim_cache_t *lanes_cache = hirschberg_uint32_sim_cache_new(4);
+    string_pair_input_t pairs[2] = {input, other};
+    string_subproblem_array *batch_results[2] = {string_subproblem_array_new(), string_subproblem_array_new()};
+    for (size_t i = 0; i < 2; i++) {
+        string_subproblem_array_clear(batch_results[0]);
+        string_subproblem_array_clear(batch_results[1]);
+        ASSERT(hirschberg_uint32_sim_lanes_align_cached(lanes_cache, pairs, 2, options,
+            hirschberg_uint32_sim_lanes_unit_cost, NULL, NULL, NULL, NULL, batch_results));
+        ASSERT_EQ(batch_results[0]->n, expected->n);
+        ASSERT(memcmp(batch_results[0]->a, expected->a, sizeof(string_subproblem_t) * expected->n) == 0);
+    }
+    stats = hirschberg_uint32_sim_cache_stats(lanes_cache);
+    ASSERT_EQ(stats.hits, 2);
+    ASSERT_EQ(stats.misses, 2);
+    hirschberg_uint32_sim_cache_destroy(lanes_cache);
+    string_subproblem_array_destroy(batch_results[0]);
+    string_subproblem_array_destroy(batch_results[1]);
+
+    string_subproblem_array_destroy(results);
+    string_subproblem_array_destroy(expected);
+    PASS();
+}
+
+TEST test_hirschberg_filter(void) {
+    const char *pairs_s1[] = {"Brooklyn", "kitten", "abc", "abcdef", "Straße", "Ünïcödé", "Lafayette Avenue"};
+    const char *pairs_s2[] = {"brooklin", "sitting", "xyz", "fedcba", "STRASSE", "unicode", "Lafayette Ave"};
+    bool pairs_utf8[] = {false, false, false, false, true, true, false};
+    size_t num_pairs = sizeof(pairs_s1) / sizeof(pairs_s1[0]);
+    // survives max_distance = 2 with bigrams: case folding, codepoint histograms; the rest are each
+    // removed by one of the histogram, q-gram and length bounds
+    bool expected[] = {true, false, false, false, true, false, false};
+
+    string_pair_input_t pairs[num_pairs];
+    for (size_t i = 0; i < num_pairs; i++) {
+        pairs[i] = (string_pair_input_t){.s1 = pairs_s1[i], .m = strlen(pairs_s1[i]), .s2 = pairs_s2[i], .n = strlen(pairs_s2[i])};
+        hirschberg_options_t options = (hirschberg_options_t){.utf8 = pairs_utf8[i], .allow_transpose = false, .init_values_zero = false};
+        ASSERT_EQ(hirschberg_filter_pair(pairs[i], options, 2, 2), expected[i]);
+    }
+
+    // batches keep the survivors in order
+    hirschberg_options_t options = (hirschberg_options_t){.utf8 = true, .allow_transpose = false, .init_values_zero = false};
+    string_pair_input_t survivors[num_pairs];
+    size_t survivor_indices[num_pairs];
+    size_t num_survivors = hirschberg_filter_pairs(pairs, num_pairs, options, 2, 2, survivors, survivor_indices);
+    ASSERT_EQ(num_survivors, 2);
+    ASSERT_EQ(survivor_indices[0], 0);
+    ASSERT_EQ(survivor_indices[1], 4);
+    ASSERT(survivors[1].s1 == pairs[4].s1);
+
+    // a looser threshold only ever keeps more
+    ASSERT(hirschberg_filter_pairs(pairs, num_pairs, options, 3, 2, NULL, NULL) >= num_survivors);
+    PASS();
+}
+
+TEST test_hirschberg_lcs_fused_split_correctness(void) {
+    size_t num_test_cases = sizeof(test_data_lcs) / sizeof(lcs_test_t);
+    for (size_t i = 0; i < num_test_cases; i++) {
+        lcs_test_t test = test_data_lcs[i];
+        ASSERT(test_hirschberg_subproblem_lcs(test, true, false));
     }
     PASS();
 }
 
 SUITE(test_lcs_alignment_suite) {
     RUN_TEST(test_hirschberg_lcs_subproblem_correctness);
+    RUN_TEST(test_hirschberg_lcs_fused_split_correctness);
+    RUN_TEST(test_hirschberg_lcs_levels_correctness);
+    RUN_TEST(test_hirschberg_lcs_lanes_correctness);
+    RUN_TEST(test_hirschberg_lanes_batch);
+    RUN_TEST(test_hirschberg_lcs_prepared_correctness);
+    RUN_TEST(test_hirschberg_local_alignment);
+    RUN_TEST(test_hirschberg_negative_split_scores);
+    RUN_TEST(test_hirschberg_fitting_alignment);
+    RUN_TEST(test_hirschberg_incremental_realign);
+    RUN_TEST(test_hirschberg_four_russians);
+    RUN_TEST(test_hirschberg_tiled);
+    RUN_TEST(test_hirschberg_checkpoint_resume);
+    RUN_TEST(test_hirschberg_result_cache);
+    RUN_TEST(test_hirschberg_filter);
 }
 
 